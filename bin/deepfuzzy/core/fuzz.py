@@ -378,7 +378,8 @@ class FuzzerFrontend(AnalysisBackend):
     L.debug("CC=%s and CXX=%s", env['CC'], env['CXX'])
 
     # initialize command with prepended compiler
-    compiler_args: List[str] = ["-std=c++11", self.compile_test] + flags + ["-o", _out_bin] # type: ignore
+    # the DeepFuzzy libraries use pthreads (e.g. for `--async_save`)
+    compiler_args: List[str] = ["-std=c++11", self.compile_test] + flags + ["-pthread", "-o", _out_bin] # type: ignore
     compile_cmd = [self.compiler_exe] + compiler_args
     L.debug("Compilation command: %s", compile_cmd)
 
@@ -18,9 +18,19 @@ import argparse
 import subprocess
 import os
 import re
+import struct
 import sys
 import time
 
+# Records of the binary trace written with --trace_reads: the offset and width
+# of the input read, the site that read it, the value read, and its kind (see
+# enum DeepFuzzy_TraceKind in DeepFuzzy.h).
+TRACE_RECORD = struct.Struct("=IIQqBB6x")
+TRACE_KINDS_READ = (2, 3, 4, 5, 6)
+TRACE_RANGE_CONVERSION = 7
+TRACE_ONEOF_BEGIN = 8
+TRACE_ONEOF_END = 9
+
 
 def main():
   global candidateRuns, currentTest, s, passStart
@@ -106,16 +116,20 @@ def main():
   if args.candidateName is not None:
     candidateName = args.candidateName
 
+  traceName = ".reducer." + str(os.getpid()) + ".trace"
+
   def runCandidate(candidate):
     global candidateRuns
 
     candidateRuns += 1
     if (time.time() - start) > args.timeout:
       raise TimeoutException
+    if os.path.exists(traceName):
+      os.remove(traceName)
     with open(".reducer." + str(os.getpid()) + ".out", 'w') as outf:
       if args.cmdArgs is None:
         cmd = [deepfuzzy + " --input_test_file " +
-             candidate + " --verbose_reads"]
+             candidate + " --trace_reads " + traceName]
         if whichTest is not None:
           cmd += ["--input_which_test", whichTest]
         if not args.fork:
@@ -128,10 +142,20 @@ def main():
       for line in inf:
         dline = line.decode("utf-8", "ignore")
         result.append(dline)
-    return (result, exitCode)
+    # Without a trace, e.g. with --cmdArgs, structure comes from the output of
+    # --verbose_reads, if any.
+    trace = None
+    if os.path.exists(traceName):
+      with open(traceName, 'rb') as inf:
+        data = inf.read()
+      data = data[:len(data) - (len(data) % TRACE_RECORD.size)]
+      trace = [TRACE_RECORD.unpack_from(data, i)
+               for i in range(0, len(data), TRACE_RECORD.size)]
+      os.remove(traceName)
+    return (result, exitCode, trace)
 
   def checks(resultAndExitCode):
-    (result, exitCode) = resultAndExitCode
+    (result, exitCode, trace) = resultAndExitCode
     if (args.exitCriterion is None) and (checkRegExp is None) and (checkString is None):
       # Only apply default DeepFuzzy failure check if no other criteria were defined
       for line in result:
@@ -211,12 +235,25 @@ def main():
     return (OneOfs + delims, lastRead)
 
   def structure(resultAndExitCode):
-    (result, exitCode) = resultAndExitCode
+    (result, exitCode, trace) = resultAndExitCode
     lastRead = len(currentTest) - 1
     if args.noStructure:
       return ([], lastRead)
     OneOfs = []
     currentOneOf = []
+    if trace is not None:
+      for (offset, width, site, value, kind, bits) in trace:
+        if kind == TRACE_ONEOF_BEGIN:
+          currentOneOf.append(-1)
+        elif (kind in TRACE_KINDS_READ) and (width > 0):
+          lastRead = offset + width - 1
+          if len(currentOneOf) > 0:
+            if currentOneOf[-1] == -1:
+              currentOneOf[-1] = offset
+        elif kind == TRACE_ONEOF_END:
+          OneOfs.append((currentOneOf[-1], lastRead))
+          currentOneOf = currentOneOf[:-1]
+      return (OneOfs, lastRead)
     for line in result:
       if "STARTING OneOf CALL" in line:
         currentOneOf.append(-1)
@@ -231,8 +268,13 @@ def main():
     return (OneOfs, lastRead)
 
   def rangeConversions(resultAndExitCode):
-    (result, exitCode) = resultAndExitCode
+    (result, exitCode, trace) = resultAndExitCode
     conversions = []
+    if trace is not None:
+      for (offset, width, site, value, kind, bits) in trace:
+        if kind == TRACE_RANGE_CONVERSION:
+          conversions.append(((offset, offset + width - 1), value))
+      return conversions
     startedMulti = False
     multiFirst = None
     for line in result:
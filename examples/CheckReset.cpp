@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2019 KhulnaSoft DevOps, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <deepfuzzy/DeepFuzzy.hpp>
+
+#include <set>
+
+using namespace deepfuzzy;
+
+/* Values seen by each test. `seen` is reset between in-process runs, but
+ * `leaked` is not, so `--check_reset` flags the test that uses it. */
+static std::set<int> seen;
+static std::set<int> leaked;
+
+static void ResetSeen(void) {
+  seen.clear();
+}
+
+static const bool registered = (DeepFuzzy_RegisterReset(ResetSeen), true);
+
+TEST(CheckReset, ResetState) {
+  int x = DeepFuzzy_IntInRange(0, 10);
+  ASSERT(seen.insert(x).second) << "Saw " << x << " before";
+}
+
+TEST(CheckReset, LeakyState) {
+  int x = DeepFuzzy_IntInRange(0, 10);
+  ASSERT(leaked.insert(x).second) << "Saw " << x << " before";
+}
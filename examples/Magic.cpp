@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2019 KhulnaSoft DevOps, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <deepfuzzy/DeepFuzzy.hpp>
+
+using namespace deepfuzzy;
+
+/* Random inputs almost never start with "Fuzz", but with coverage feedback
+ * the fuzzer can find them one byte at a time. Each byte is read on its own,
+ * so that the compiler keeps a branch per byte. */
+TEST(Magic, Bytes) {
+  if (DeepFuzzy_Char() == 'F') {
+    if (DeepFuzzy_Char() == 'u') {
+      if (DeepFuzzy_Char() == 'z') {
+        if (DeepFuzzy_Char() == 'z') {
+          ASSERT(false) << "Found the magic bytes";
+        }
+      }
+    }
+  }
+}
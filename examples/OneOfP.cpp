@@ -37,3 +37,27 @@ TEST(WithProbs, WP) {
   out[p] = '!';
   LOG(TRACE) << "RESULT: '" << out << "'";
 }
+
+TEST(WithProbs, SameLine) {
+  char out[9];
+  out[8] = '\0';
+  for (int i = 0; i < 8; i++) {
+    // Both `OneOfP`s share a call site, but not the number of choices.
+    i % 2 ? OneOfP(0.2, [&]{out[i] = 'a';}, 0.3, [&]{out[i] = 'b';}, 0.5, [&]{out[i] = 'c';}) : OneOfP(0.7, [&]{out[i] = 'x';}, 0.3, [&]{out[i] = 'y';});
+  }
+  LOG(TRACE) << "SAMELINE: '" << out << "'";
+}
+
+TEST(WithProbs, Varying) {
+  char out[11];
+  out[10] = '\0';
+  for (int i = 0; i < 8; i++) {
+    double p = i % 2 ? 0.9 : 0.1;
+    OneOfP(p, [&]{out[i] = 'a';}, 1 - p, [&]{out[i] = 'b';});
+  }
+  // Both `OneOfP`s share a call site and the number of choices.
+  char first[2] = {'c', 'd'};
+  std::vector<char> second = {'e', 'f'};
+  out[8] = OneOfP({0.9}, first); out[9] = OneOfP({0.2}, second);
+  LOG(TRACE) << "VARYING: '" << out << "'";
+}
@@ -46,6 +46,13 @@
 # define DEEPFUZZY_NOINLINE __attribute__((noinline))
 #endif
 
+/* Align a type to `n` bytes, e.g. to keep data on its own cache line. */
+#if defined(_MSC_VER)
+# define DEEPFUZZY_ALIGNED(n) __declspec(align(n))
+#else
+# define DEEPFUZZY_ALIGNED(n) __attribute__((aligned(n)))
+#endif
+
 /* Introduce a trap instruction to halt execution. */
 #if defined(_MSC_VER)
 # include <intrin.h>
@@ -98,6 +105,36 @@
     static void f(void)
 #endif
 
+/* Hint that `x` is usually false. */
+#if defined(_MSC_VER)
+# define DEEPFUZZY_UNLIKELY(x) (x)
+#else
+# define DEEPFUZZY_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#endif
+
+/* Address the current function will return to. */
+#if defined(_MSC_VER)
+# include <intrin.h>
+# define DEEPFUZZY_RETURN_ADDRESS() _ReturnAddress()
+#else
+# define DEEPFUZZY_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+
+/* Convert a 16-, 32- or 64-bit big-endian integer to the host's byte order. */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+# define DEEPFUZZY_FROM_BIG_ENDIAN16(x) (x)
+# define DEEPFUZZY_FROM_BIG_ENDIAN32(x) (x)
+# define DEEPFUZZY_FROM_BIG_ENDIAN64(x) (x)
+#elif defined(_MSC_VER)
+# define DEEPFUZZY_FROM_BIG_ENDIAN16(x) _byteswap_ushort(x)
+# define DEEPFUZZY_FROM_BIG_ENDIAN32(x) _byteswap_ulong(x)
+# define DEEPFUZZY_FROM_BIG_ENDIAN64(x) _byteswap_uint64(x)
+#else
+# define DEEPFUZZY_FROM_BIG_ENDIAN16(x) __builtin_bswap16(x)
+# define DEEPFUZZY_FROM_BIG_ENDIAN32(x) __builtin_bswap32(x)
+# define DEEPFUZZY_FROM_BIG_ENDIAN64(x) __builtin_bswap64(x)
+#endif
+
 #define DEEPFUZZY_BARRIER() \
     asm volatile ("":::"memory")
 
@@ -38,6 +38,10 @@
 #include <deepfuzzy/Option.h>
 #include <deepfuzzy/Stream.h>
 
+#if defined(__cplusplus) && defined(__cpp_exceptions)
+#include <new>
+#endif
+
 #ifdef assert
 # undef assert
 #endif
@@ -59,6 +63,18 @@
 #define DEEPFUZZY_MAX_SWARM_CONFIGS 1024
 #endif
 
+#ifndef DEEPFUZZY_MAX_CALL_SITES
+#define DEEPFUZZY_MAX_CALL_SITES 4096
+#endif
+
+#ifndef DEEPFUZZY_MAX_RESET_FUNCS
+#define DEEPFUZZY_MAX_RESET_FUNCS 64
+#endif
+
+#ifndef DEEPFUZZY_MAX_FAIL_LOCATION
+#define DEEPFUZZY_MAX_FAIL_LOCATION 256
+#endif
+
 #ifndef DEEPFUZZY_SWARM_MAX_PROB_RATIO
 #define DEEPFUZZY_SWARM_MAX_PROB_RATIO 16
 #endif
@@ -76,6 +92,7 @@ DECLARE_string(input_test_files_dir);
 DECLARE_string(input_which_test);
 DECLARE_string(output_test_dir);
 DECLARE_string(test_filter);
+DECLARE_string(trace_reads);
 
 DECLARE_bool(input_stdin);
 DECLARE_bool(take_over);
@@ -88,21 +105,109 @@ DECLARE_bool(fork);
 DECLARE_bool(list_tests);
 DECLARE_bool(boring_only);
 DECLARE_bool(run_disabled);
+DECLARE_bool(check_reset);
+DECLARE_bool(compact_encoding);
 
 DECLARE_int(min_log_level);
 DECLARE_int(seed);
 DECLARE_int(timeout);
 
-enum {
-  DeepFuzzy_InputSize = DEEPFUZZY_SIZE
-};
+DECLARE_uint(exec_timeout_ms);
+DECLARE_uint(rss_limit_mb);
 
+DECLARE_uint(max_input_size);
 
 /* Byte buffer that will contain symbolic data that is used to supply requests
- * for symbolic values (e.g. `int`s). */
-extern volatile uint8_t DeepFuzzy_Input[DeepFuzzy_InputSize];
+ * for symbolic values (e.g. `int`s), and its size in bytes. Under symbolic
+ * execution, and until `DeepFuzzy_InitInputBuffer` runs, this is a static
+ * buffer of `DEEPFUZZY_SIZE` bytes. */
+extern volatile uint8_t *DeepFuzzy_Input;
+extern uint32_t DeepFuzzy_InputSize;
+
+/* Replace the static input buffer with one of `--max_input_size` bytes, that
+ * is followed by an inaccessible guard page. Does nothing under symbolic
+ * execution, where the executors make the static buffer symbolic. */
+extern void DeepFuzzy_InitInputBuffer(void);
+
+/* Choose how input bytes are read, once the options are parsed. Concrete runs
+ * (replay, libFuzzer and the built-in fuzzer) copy whole values out of the
+ * input buffer; symbolic execution, `--verbose_reads` and `--trace_reads` read
+ * every byte through `DEEPFUZZY_READBYTE`. Called by `DeepFuzzy_InitInputBuffer`. */
+extern void DeepFuzzy_SelectReadPath(void);
+
+/* Set by `DeepFuzzy_SelectReadPath` in concrete runs with `--compact_encoding`.
+ * Booleans then take one bit of the input, and integers in a range only as
+ * many bits as the size of the range needs, read from a cursor over the input
+ * bytes. Other values start at the next whole byte. */
+extern int DeepFuzzy_CompactEncoding;
+
+/* Read `num_bits` (at most 64) bits of the input, most significant first. */
+extern uint64_t DeepFuzzy_ReadBits(unsigned num_bits);
+
+/* Read a value in `[0, span]` with the compact encoding. */
+extern uint64_t DeepFuzzy_CompactRange(uint64_t span);
+
+/* Harnesses built with `DEEPFUZZY_COMPACT_ENCODING` defined default to
+ * `--compact_encoding`, so that replay, the built-in fuzzer and libFuzzer all
+ * agree on the input format. */
+#ifdef DEEPFUZZY_COMPACT_ENCODING
+DEEPFUZZY_INITIALIZER(DeepFuzzy_DefaultToCompactEncoding) {
+  FLAGS_compact_encoding = 1;
+}
+#endif
+
+/* Kinds of records in the `--trace_reads` trace. */
+enum DeepFuzzy_TraceKind {
+  /* A test starts. */
+  DeepFuzzy_TraceTestBegin = 1,
+
+  /* Input read as raw bytes, e.g. for a `float`, as string characters without
+   * null bytes, as a boolean, as a big-endian integer, or as bits of the
+   * compact encoding. */
+  DeepFuzzy_TraceBytes,
+  DeepFuzzy_TraceCStr,
+  DeepFuzzy_TraceBool,
+  DeepFuzzy_TraceInt,
+  DeepFuzzy_TraceBits,
+
+  /* The integer just read was out of range, and got wrapped to `value`. */
+  DeepFuzzy_TraceRangeConversion,
+
+  /* A `OneOf` of `value` alternatives starts, or the chosen one returned. */
+  DeepFuzzy_TraceOneOfBegin,
+  DeepFuzzy_TraceOneOfEnd
+};
+
+/* A record of the `--trace_reads` trace, written in native byte order. */
+struct DeepFuzzy_TraceRecord {
+  uint32_t offset;  /* Index of the first input byte read. */
+  uint32_t width;   /* Number of input bytes read. */
+  uint64_t site;    /* Address identifying the code that read them. */
+  int64_t value;    /* Value read, if any. */
+  uint8_t kind;     /* A `DeepFuzzy_TraceKind`. */
+  uint8_t bits;     /* Number of bits read, for `DeepFuzzy_TraceBits`. */
+  uint8_t reserved[6];
+};
 
-#define DEEPFUZZY_READBYTE ((DeepFuzzy_UsingSymExec ? 1 : (DeepFuzzy_InputIndex < DeepFuzzy_InputInitialized ? 1 : (DeepFuzzy_InternalFuzzing ? (DeepFuzzy_Input[DeepFuzzy_InputIndex] = (char)rand()) : (DeepFuzzy_Input[DeepFuzzy_InputIndex] = 0)))), DeepFuzzy_Input[DeepFuzzy_InputIndex++])
+/* Set by `DeepFuzzy_SelectReadPath` in concrete runs with `--trace_reads`.
+ * Input is then read one byte at a time, as with `--verbose_reads`. */
+extern int DeepFuzzy_TraceReads;
+
+/* Write a record to the `--trace_reads` trace. A `site` of `0` stands for the
+ * site of the previous record, e.g. for range conversions. */
+extern void DeepFuzzy_TraceRead(enum DeepFuzzy_TraceKind kind, uint32_t offset,
+                                uint32_t width, int64_t value, uint64_t site);
+
+#define DEEPFUZZY_READBYTE ((DeepFuzzy_UsingSymExec ? 1 : (DeepFuzzy_InputIndex < DeepFuzzy_InputInitialized ? 1 : (DeepFuzzy_InternalFuzzing ? DeepFuzzy_FuzzFillBlock() : (DeepFuzzy_Input[DeepFuzzy_InputIndex] = 0)))), DeepFuzzy_Input[DeepFuzzy_InputIndex++])
+
+/* Number of bytes the built-in fuzzer generates at a time, ahead of the
+ * input index. */
+#define DEEPFUZZY_FUZZ_BLOCK_SIZE 64
+
+/* Fill the uninitialized input bytes up to the end of the block containing
+ * the input index with random data from the built-in fuzzer, and return the
+ * byte at the input index. */
+extern uint8_t DeepFuzzy_FuzzFillBlock(void);
 
 /* Index into the `DeepFuzzy_Input` array that tracks how many input bytes have
  * been consumed. */
@@ -118,7 +223,9 @@ enum DeepFuzzy_SwarmType {
 
 /* Contains info about a swarm configuration */
 struct DeepFuzzy_SwarmConfig {
-  char* file;
+  /* The library's own copy of the call site's file name, which lives as long
+   * as the process. */
+  const char* file;
   unsigned line;
   unsigned orig_fcount;
   /* We identify a configuration by these first three elements of the struct */
@@ -126,14 +233,40 @@ struct DeepFuzzy_SwarmConfig {
   /* These fields allow us to map choices to the restricted configuration */
   unsigned fcount;
   unsigned* fmap;
+
+  /* Call site of `file` and `line`, and index of the previous configuration
+   * of the same call site with a different `orig_fcount`, if any. */
+  unsigned site;
+  unsigned prev;
 };
 
 /* Index into the set of swarm configurations. */
 extern uint32_t DeepFuzzy_SwarmConfigsIndex;
 
+/* Return the ID of the call site at `line` of `file`, registering it on first
+ * use. IDs are small integers, and the same for all calls with the same file
+ * name and line. */
+extern unsigned DeepFuzzy_RegisterCallSite(const char *file, unsigned line);
+
+/* ID of the call site this is expanded at. In C++ it is looked up once per
+ * expansion, in C on every call. */
+#ifdef __cplusplus
+# define DEEPFUZZY_CALL_SITE() \
+    ([]() -> unsigned { \
+      static const unsigned site = DeepFuzzy_RegisterCallSite(__FILE__, __LINE__); \
+      return site; \
+    }())
+#else
+# define DEEPFUZZY_CALL_SITE() DeepFuzzy_RegisterCallSite(__FILE__, __LINE__)
+#endif
+
 /* Function to return a swarm configuration. */
 extern struct DeepFuzzy_SwarmConfig* DeepFuzzy_GetSwarmConfig(unsigned fcount, const char* file, unsigned line, enum DeepFuzzy_SwarmType stype);
 
+/* Return the swarm configuration of the call site `site` for `fcount` choices,
+ * generating it on first use in a test. */
+extern struct DeepFuzzy_SwarmConfig* DeepFuzzy_GetSwarmConfigAt(unsigned site, unsigned fcount, enum DeepFuzzy_SwarmType stype);
+
 
 #define DEEPFUZZY_FOR_EACH_INTEGER(X) \
     X(Size, size_t, size_t) \
@@ -206,8 +339,17 @@ enum DeepFuzzy_TestRunResult {
   DeepFuzzy_TestRunFail = 1,
   DeepFuzzy_TestRunCrash = 2,
   DeepFuzzy_TestRunAbandon = 3,
+  DeepFuzzy_TestRunHang = 4,
+  DeepFuzzy_TestRunOOM = 5,
 };
 
+/* Returns `true` if `result` means that the test found a bug. */
+DEEPFUZZY_INLINE static bool
+DeepFuzzy_IsFailingResult(enum DeepFuzzy_TestRunResult result) {
+  return (result == DeepFuzzy_TestRunFail) || (result == DeepFuzzy_TestRunCrash) ||
+         (result == DeepFuzzy_TestRunHang) || (result == DeepFuzzy_TestRunOOM);
+}
+
 /* Contains information about a test case */
 struct DeepFuzzy_TestInfo {
   struct DeepFuzzy_TestInfo *prev;
@@ -221,14 +363,66 @@ struct DeepFuzzy_TestRunInfo {
   struct DeepFuzzy_TestInfo *test;
   enum DeepFuzzy_TestRunResult result;
   const char *reason;
+
+  /* Source location, as `file(line)`, of the last error logged by the test,
+   * if any. */
+  char fail_location[DEEPFUZZY_MAX_FAIL_LOCATION];
+
+  /* Signal that crashed the test, and the program counter where it did, if
+   * known. */
+  int crash_signal;
+  uintptr_t crash_pc;
+
+  /* Set if the test crashed after failing to allocate memory. */
+  int out_of_memory;
+};
+
+/* Resources used by tests run in a child process, as reported by the
+ * operating system. Sums over `num_tests` tests, except for `max_rss_kb`. */
+struct DeepFuzzy_TestUsage {
+  uint64_t num_tests;
+  uint64_t max_rss_kb;
+  uint64_t user_us;
+  uint64_t sys_us;
+  uint64_t minor_faults;
+  uint64_t major_faults;
+  uint64_t voluntary_switches;
+  uint64_t involuntary_switches;
 };
 
+/* Resources used by the last test run by `DeepFuzzy_ForkAndRunTest`.
+ * `num_tests` is `0` if the test ran in this process, or if the platform
+ * doesn't report them. */
+extern struct DeepFuzzy_TestUsage DeepFuzzy_LastTestUsage;
+
+/* Add the resources in `usage` to `total`. */
+extern void DeepFuzzy_AddTestUsage(struct DeepFuzzy_TestUsage *total,
+                                   const struct DeepFuzzy_TestUsage *usage);
+
+/* Log the peak memory use and the average CPU time, page faults and context
+ * switches per test in `usage`, if any. */
+extern void DeepFuzzy_LogTestUsage(enum DeepFuzzy_LogLevel level,
+                                   const struct DeepFuzzy_TestUsage *usage);
+
 /* Information about the current test run, if any. */
 extern struct DeepFuzzy_TestRunInfo *DeepFuzzy_CurrentTestRun;
 
 /* Function to clean up generated strings, and any other DeepFuzzy-managed data. */
 extern void DeepFuzzy_CleanUp();
 
+/* A function that restores harness-defined state, e.g. static variables, to
+ * what it was before any test ran. */
+typedef void (*DeepFuzzy_ResetFunc)(void);
+
+/* Register `fn` to be called after each test that runs in-process (e.g. with
+ * `--no_fork`, or under libFuzzer), once DeepFuzzy has reset its own state.
+ * Functions are called in the order in which they were registered. */
+extern void DeepFuzzy_RegisterReset(DeepFuzzy_ResetFunc fn);
+
+/* Restore all of DeepFuzzy's per-test state, then call the registered reset
+ * functions. */
+extern void DeepFuzzy_ResetState(void);
+
 /* Returns `1` if `expr` is true, and `0` otherwise. This is kind of an indirect
  * way to take a symbolic value, introduce a fork, and on each size, replace its
  * value with a concrete value. */
@@ -337,6 +531,11 @@ extern void DeepFuzzy_SoftFail(void);
 DEEPFUZZY_NORETURN
 extern void DeepFuzzy_Pass(void);
 
+/* Stop this test because it ran out of memory, e.g. after an allocation
+ * failed under `--rss_limit_mb`. */
+DEEPFUZZY_NORETURN
+extern void DeepFuzzy_OutOfMemory(void);
+
 /* Asserts that `expr` must hold. If it does not, then the test fails and
  * immediately stops. */
 DEEPFUZZY_INLINE static void DeepFuzzy_Assert(int expr) {
@@ -370,6 +569,10 @@ DEEPFUZZY_INLINE static void DeepFuzzy_Check(int expr) {
         high = low; \
         low = copy; \
       } \
+      if (DeepFuzzy_CompactEncoding) { \
+        return (tname) ((utname) low + (utname) DeepFuzzy_CompactRange( \
+            (utname) ((utname) high - (utname) low))); \
+      } \
       tname x = DeepFuzzy_ ## Tname(); \
       if (DeepFuzzy_UsingSymExec) { \
         (void) DeepFuzzy_Assume(low <= x && x <= high); \
@@ -396,6 +599,10 @@ DEEPFUZZY_INLINE static void DeepFuzzy_Check(int expr) {
         high = low; \
         low = copy; \
       } \
+      if (DeepFuzzy_CompactEncoding) { \
+        return (tname) ((utname) low + (utname) DeepFuzzy_CompactRange( \
+            (utname) ((utname) high - (utname) low))); \
+      } \
       tname x = DeepFuzzy_ ## Tname(); \
       if (DeepFuzzy_UsingSymExec) { \
         (void) DeepFuzzy_Assume(low <= x && x <= high); \
@@ -424,6 +631,11 @@ DEEPFUZZY_INLINE static void DeepFuzzy_Check(int expr) {
           printf("Converting out-of-range value to %" PRId64 "\n", \
                  (int64_t)ret); \
         } \
+        if (DeepFuzzy_TraceReads) { \
+          DeepFuzzy_TraceRead(DeepFuzzy_TraceRangeConversion, \
+                              DeepFuzzy_InputIndex - sizeof(tname), \
+                              sizeof(tname), (int64_t) ret, 0); \
+        } \
         return ret; \
       } \
       return x; \
@@ -487,33 +699,79 @@ DEEPFUZZY_INLINE static int DeepFuzzy_IsSymbolicDouble(double x) {
   return DeepFuzzy_IsSymbolicUInt64(*((uint64_t *) &x));
 }
 
-/* Basically an ASSUME that also assigns to v; P should be side-effect
-   free, and type of v should be integral. */
 #ifndef DEEPFUZZY_MAX_SEARCH_ITERS
 #define DEEPFUZZY_MAX_SEARCH_ITERS 4294967296 // 2^32 is enough expense
 #endif
 
+enum DeepFuzzy_SearchFlags {
+  /* Values wrap around at the ends of the range, like unsigned arithmetic. */
+  DeepFuzzy_SearchWrap = 1,
+
+  /* The predicate holds on one side of some value, and not on the other. */
+  DeepFuzzy_SearchMonotone = 2
+};
+
+/* State of an `ASSIGN_SATISFYING` search for a value satisfying its predicate,
+ * used outside of symbolic execution. Values are tried close to the starting
+ * value first, then at exponentially growing distances from it, then from
+ * random points of the range, until the search or the test runs out of its
+ * budget; monotone predicates are bisected instead. */
+struct DeepFuzzy_Search {
+  const char *file;
+  unsigned line;
+  unsigned flags;
+  uint64_t low;
+  uint64_t width;
+  uint64_t start;
+  uint64_t max_iters;
+  uint64_t iters;
+  uint64_t value;
+  unsigned phase;
+  bool down;
+  uint64_t step;
+  uint64_t restart;
+  uint64_t rng;
+  uint64_t below;
+  uint64_t above;
+};
+
+/* Start a search for a value in `low` to `low + width`, from `low + start`,
+ * whose predicate is known to be false. Sets `search->value` to the first value
+ * to try. */
+extern void DeepFuzzy_BeginSearch(struct DeepFuzzy_Search *search,
+                                  const char *file, unsigned line,
+                                  uint64_t low, uint64_t width, uint64_t start,
+                                  unsigned flags, uint64_t max_iters);
+
+/* Report whether the predicate holds for `search->value`. Returns `0` once
+ * `search->value` is the value found, or sets it to the next value to try and
+ * returns `1`. Abandons the test if no value is found. */
+extern int DeepFuzzy_SearchNext(struct DeepFuzzy_Search *search, int satisfied);
+
+#define _DeepFuzzy_AssignSatisfying(v, P, low, width, start, flags) \
+  do { \
+    struct DeepFuzzy_Search DeepFuzzy_search; \
+    DeepFuzzy_BeginSearch(&DeepFuzzy_search, __FILE__, __LINE__, low, width, \
+                          start, flags, DEEPFUZZY_MAX_SEARCH_ITERS); \
+    do { \
+      v = DeepFuzzy_search.value; \
+    } while (DeepFuzzy_SearchNext(&DeepFuzzy_search, !!(P))); \
+    v = DeepFuzzy_search.value; \
+  } while (0)
+
+/* Basically an ASSUME that also assigns to v; P should be side-effect
+   free, and type of v should be integral. */
 #define ASSIGN_SATISFYING(v, expr, P) \
   do { \
     v = (expr); \
     if (DeepFuzzy_UsingSymExec) { \
       (void) DeepFuzzy_Assume(P); \
-    } else { \
-      unsigned long long DeepFuzzy_assume_iters = 0; \
-      unsigned long long DeepFuzzy_safe_incr_v = (unsigned long long) v; \
-      unsigned long long DeepFuzzy_safe_decr_v = (unsigned long long) v; \
-      while(!(P)) { \
-	if (DeepFuzzy_assume_iters > DEEPFUZZY_MAX_SEARCH_ITERS) { \
-	  (void) DeepFuzzy_Assume(0); \
-	} \
-	DeepFuzzy_assume_iters++; \
-	DeepFuzzy_safe_incr_v++; \
-        v = DeepFuzzy_safe_incr_v; \
-	if (!(P)) { \
-	  DeepFuzzy_safe_decr_v--;   \
-          v = DeepFuzzy_safe_decr_v; \
-	} \
-      } \
+    } else if (!(P)) { \
+      const uint64_t DeepFuzzy_search_width = \
+          ~0ULL >> (64 - 8 * sizeof(v)); \
+      _DeepFuzzy_AssignSatisfying(v, P, 0, DeepFuzzy_search_width, \
+                                  (uint64_t) v & DeepFuzzy_search_width, \
+                                  DeepFuzzy_SearchWrap); \
     } \
   } while (0);
 
@@ -521,31 +779,28 @@ DEEPFUZZY_INLINE static int DeepFuzzy_IsSymbolicDouble(double x) {
    P should be side-effect free, and type of v should be integral. */
 
 #define ASSIGN_SATISFYING_IN_RANGE(v, expr, low, high, P) \
+  _DeepFuzzy_AssignSatisfyingInRange(v, expr, low, high, P, 0)
+
+/* Like `ASSIGN_SATISFYING_IN_RANGE`, for a predicate P that is either false
+   up to some value and true from there on, or the other way around. Finds
+   the value closest to the boundary, on the side P holds, by bisection. */
+#define ASSIGN_SATISFYING_MONOTONE_IN_RANGE(v, expr, low, high, P) \
+  _DeepFuzzy_AssignSatisfyingInRange(v, expr, low, high, P, \
+                                     DeepFuzzy_SearchMonotone)
+
+#define _DeepFuzzy_AssignSatisfyingInRange(v, expr, low, high, P, flags) \
   do { \
     v = (expr); \
     (void) DeepFuzzy_Assume(low <= v && v <= high); \
     if (DeepFuzzy_UsingSymExec) { \
       (void) DeepFuzzy_Assume(P);\
-    } else { \
-      unsigned long long DeepFuzzy_assume_iters = 0; \
-      long long DeepFuzzy_safe_incr_v = (long long) v; \
-      long long DeepFuzzy_safe_decr_v = (long long) v; \
-      while(!(P)) { \
-	if (DeepFuzzy_assume_iters > DEEPFUZZY_MAX_SEARCH_ITERS) { \
-	  (void) DeepFuzzy_Assume(0); \
-	} \
-	DeepFuzzy_assume_iters++; \
-	if (DeepFuzzy_safe_incr_v < high) {	\
-	  DeepFuzzy_safe_incr_v++; \
-          v = DeepFuzzy_safe_incr_v; \
-	} else if (DeepFuzzy_safe_decr_v == low) { \
-	  (void) DeepFuzzy_Assume(0); \
-	} \
-	if (!(P) && (DeepFuzzy_safe_decr_v > low)) {	\
-	  DeepFuzzy_safe_decr_v--; \
-          v = DeepFuzzy_safe_decr_v; \
-	} \
-      } \
+    } else if (!(P)) { \
+      const long long DeepFuzzy_search_low = (long long) (low); \
+      _DeepFuzzy_AssignSatisfying( \
+          v, P, (uint64_t) DeepFuzzy_search_low, \
+          (uint64_t) ((long long) (high)) - (uint64_t) DeepFuzzy_search_low, \
+          (uint64_t) ((long long) v) - (uint64_t) DeepFuzzy_search_low, \
+          flags); \
     } \
   } while (0);
 
@@ -612,6 +867,20 @@ extern void DeepFuzzy_SaveFailingTest(void);
 /* Save a crashing test to the output test directory. */
 extern void DeepFuzzy_SaveCrashingTest(void);
 
+/* Save a test that ran for longer than `--exec_timeout_ms` to the output test
+ * directory. */
+extern void DeepFuzzy_SaveHangingTest(void);
+
+/* Save a test that ran out of memory to the output test directory. */
+extern void DeepFuzzy_SaveOutOfMemoryTest(void);
+
+/* Arm or disarm the `--exec_timeout_ms` timer for a test run in this process.
+ * When the timer expires, the test's result is set to `DeepFuzzy_TestRunHang`
+ * and it is interrupted by a jump to `DeepFuzzy_ReturnToRun`. Stopping the
+ * timer returns `true` if it had expired. Platform specific functions. */
+extern void DeepFuzzy_StartExecTimer(void);
+extern bool DeepFuzzy_StopExecTimer(void);
+
 /* Jump buffer for returning to `DeepFuzzy_Run`. */
 extern jmp_buf DeepFuzzy_ReturnToRun;
 
@@ -628,6 +897,8 @@ static bool DeepFuzzy_IsTestCaseFile(const char *name) {
     ".pass",
     ".fail",
     ".crash",
+    ".hang",
+    ".oom",
   };
   const size_t ext_count = sizeof(extensions) / sizeof(char *);
 
@@ -679,11 +950,17 @@ static void DeepFuzzy_RunTest(struct DeepFuzzy_TestInfo *test) {
       exit(DeepFuzzy_TestRunPass);
 
 #if defined(__cplusplus) && defined(__cpp_exceptions)
+    } catch(const std::bad_alloc &) {
+      DeepFuzzy_OutOfMemory();
     } catch(...) {
       DeepFuzzy_Fail();
     }
 #endif  /* __cplusplus */
 
+    /* The test ran out of memory; the parent reports and saves it. */
+  } else if (DeepFuzzy_CurrentTestRun->result == DeepFuzzy_TestRunOOM) {
+    exit(DeepFuzzy_TestRunOOM);
+
     /* We caught a failure when running the test. */
   } else if (DeepFuzzy_CatchFail()) {
     DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Failed: %s", test->test_name);
@@ -719,15 +996,27 @@ static int DeepFuzzy_RunTestNoFork(struct DeepFuzzy_TestInfo *test) {
     try {
 #endif  /* __cplusplus */
 
+      DeepFuzzy_StartExecTimer();
       test->test_func();  /* Run the test function. */
+      DeepFuzzy_StopExecTimer();
       return(DeepFuzzy_TestRunPass);
 
 #if defined(__cplusplus) && defined(__cpp_exceptions)
+    } catch(const std::bad_alloc &) {
+      DeepFuzzy_OutOfMemory();
     } catch(...) {
       DeepFuzzy_Fail();
     }
 #endif  /* __cplusplus */
 
+    /* The test ran out of time; the caller reports and saves it. */
+  } else if (DeepFuzzy_StopExecTimer()) {
+    return(DeepFuzzy_TestRunHang);
+
+    /* The test ran out of memory; the caller reports and saves it. */
+  } else if (DeepFuzzy_CurrentTestRun->result == DeepFuzzy_TestRunOOM) {
+    return(DeepFuzzy_TestRunOOM);
+
     /* We caught a failure when running the test. */
   } else if (DeepFuzzy_CatchFail()) {
     DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Failed: %s", test->test_name);
@@ -764,6 +1053,7 @@ extern enum DeepFuzzy_TestRunResult DeepFuzzy_FuzzOneTestCase(struct DeepFuzzy_T
 static enum DeepFuzzy_TestRunResult
 DeepFuzzy_RunSavedTestCase(struct DeepFuzzy_TestInfo *test, const char *dir,
                            const char *name) {
+  memset(&DeepFuzzy_LastTestUsage, 0, sizeof(DeepFuzzy_LastTestUsage));
   if (!setjmp(DeepFuzzy_ReturnToRun)) {
     size_t path_len = 2 + sizeof(char) * (strlen(dir) + strlen(name));
     char *path = (char *) malloc(path_len);
@@ -785,6 +1075,7 @@ DeepFuzzy_RunSavedTestCase(struct DeepFuzzy_TestInfo *test, const char *dir,
     DeepFuzzy_Begin(test);
 
     enum DeepFuzzy_TestRunResult result = DeepFuzzy_ForkAndRunTest(test);
+    DeepFuzzy_LogTestUsage(DeepFuzzy_LogTrace, &DeepFuzzy_LastTestUsage);
 
     if (result == DeepFuzzy_TestRunFail) {
       DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Test case %s failed", path);
@@ -799,6 +1090,22 @@ DeepFuzzy_RunSavedTestCase(struct DeepFuzzy_TestInfo *test, const char *dir,
       }
 
       DeepFuzzy_Crash();
+    }
+    else if (result == DeepFuzzy_TestRunHang) {
+      DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Timed out: %s", test->test_name);
+      DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Test case %s timed out", path);
+      free(path);
+      if (HAS_FLAG_output_test_dir) {
+        DeepFuzzy_SaveHangingTest();
+      }
+    }
+    else if (result == DeepFuzzy_TestRunOOM) {
+      DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Out of memory: %s", test->test_name);
+      DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Test case %s ran out of memory", path);
+      free(path);
+      if (HAS_FLAG_output_test_dir) {
+        DeepFuzzy_SaveOutOfMemoryTest();
+      }
     } else {
       free(path);
     }
@@ -838,6 +1145,8 @@ static int DeepFuzzy_RunSavedCasesForTest(struct DeepFuzzy_TestInfo *test) {
   }
 
   unsigned int i = 0;
+  struct DeepFuzzy_TestUsage usage;
+  memset(&usage, 0, sizeof(usage));
 
   /* Read generated test cases and run a test for each file found. */
   while ((dp = readdir(dir_fd)) != NULL) {
@@ -845,6 +1154,7 @@ static int DeepFuzzy_RunSavedCasesForTest(struct DeepFuzzy_TestInfo *test) {
       i++;
       enum DeepFuzzy_TestRunResult result =
         DeepFuzzy_RunSavedTestCase(test, test_case_dir, dp->d_name);
+      DeepFuzzy_AddTestUsage(&usage, &DeepFuzzy_LastTestUsage);
 
       if (result != DeepFuzzy_TestRunPass) {
         num_failed_tests++;
@@ -856,6 +1166,7 @@ static int DeepFuzzy_RunSavedCasesForTest(struct DeepFuzzy_TestInfo *test) {
 
   DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "Ran %u tests for %s; %d tests failed",
 		      i, test->test_name, num_failed_tests);
+  DeepFuzzy_LogTestUsage(DeepFuzzy_LogInfo, &usage);
 
   return num_failed_tests;
 }
@@ -928,8 +1239,9 @@ static int DeepFuzzy_RunSingleSavedTestCase(void) {
 
   enum DeepFuzzy_TestRunResult result =
     DeepFuzzy_RunSavedTestCase(test, "", FLAGS_input_test_file);
+  DeepFuzzy_LogTestUsage(DeepFuzzy_LogInfo, &DeepFuzzy_LastTestUsage);
 
-  if ((result == DeepFuzzy_TestRunFail) || (result == DeepFuzzy_TestRunCrash)) {
+  if (DeepFuzzy_IsFailingResult(result)) {
     if (FLAGS_abort_on_fail) {
       DeepFuzzy_HardCrash();
     }
@@ -972,8 +1284,9 @@ static int DeepFuzzy_RunTestFromStdin(void) {
 
   enum DeepFuzzy_TestRunResult result =
     DeepFuzzy_RunSavedTestCase(test, "", "** STDIN **");
+  DeepFuzzy_LogTestUsage(DeepFuzzy_LogInfo, &DeepFuzzy_LastTestUsage);
 
-  if ((result == DeepFuzzy_TestRunFail) || (result == DeepFuzzy_TestRunCrash)) {
+  if (DeepFuzzy_IsFailingResult(result)) {
     if (FLAGS_abort_on_fail) {
       DeepFuzzy_HardCrash();
     }
@@ -1035,6 +1348,8 @@ static int DeepFuzzy_RunSingleSavedTestDir(void) {
   }
 
   unsigned int i = 0;
+  struct DeepFuzzy_TestUsage usage;
+  memset(&usage, 0, sizeof(usage));
 
   /* Read generated test cases and run a test for each file found. */
   while ((dp = readdir(dir_fd)) != NULL) {
@@ -1049,8 +1364,9 @@ static int DeepFuzzy_RunSingleSavedTestDir(void) {
     i++;
     enum DeepFuzzy_TestRunResult result =
       DeepFuzzy_RunSavedTestCase(test, FLAGS_input_test_files_dir, dp->d_name);
+    DeepFuzzy_AddTestUsage(&usage, &DeepFuzzy_LastTestUsage);
 
-    if ((result == DeepFuzzy_TestRunFail) || (result == DeepFuzzy_TestRunCrash)) {
+    if (DeepFuzzy_IsFailingResult(result)) {
       if (FLAGS_abort_on_fail) {
         DeepFuzzy_HardCrash();
       }
@@ -1064,6 +1380,7 @@ static int DeepFuzzy_RunSingleSavedTestDir(void) {
 
   DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "Ran %u tests; %d tests failed",
 		      i, num_failed_tests);
+  DeepFuzzy_LogTestUsage(DeepFuzzy_LogInfo, &usage);
 
   return num_failed_tests;
 }
@@ -1096,6 +1413,8 @@ static int DeepFuzzy_Run(void) {
     DeepFuzzy_Abandon("Please call DeepFuzzy_InitOptions(argc, argv) in main");
   }
 
+  DeepFuzzy_InitInputBuffer();
+
   if (HAS_FLAG_list_tests) {
     return DeepFuzzy_RunListTests();
   }
@@ -20,8 +20,11 @@
 #include <deepfuzzy/DeepFuzzy.h>
 #include <deepfuzzy/Stream.hpp>
 
+#include <algorithm>
+#include <deque>
 #include <functional>
 #include <string>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -325,9 +328,9 @@ inline static void ForAll(Closure func) {
   func(Symbolic<Args>()...);
 }
 
-#define PureSwarmOneOf(...) _SwarmOneOf(__FILE__, __LINE__, DeepFuzzy_SwarmTypePure, __VA_ARGS__)
-#define MixedSwarmOneOf(...) _SwarmOneOf(__FILE__, __LINE__, DeepFuzzy_SwarmTypeMixed, __VA_ARGS__)
-#define ProbSwarmOneOf(...) _SwarmOneOf(__FILE__, __LINE__, DeepFuzzy_SwarmTypeProb, __VA_ARGS__)
+#define PureSwarmOneOf(...) _SwarmOneOf(DEEPFUZZY_CALL_SITE(), DeepFuzzy_SwarmTypePure, __VA_ARGS__)
+#define MixedSwarmOneOf(...) _SwarmOneOf(DEEPFUZZY_CALL_SITE(), DeepFuzzy_SwarmTypeMixed, __VA_ARGS__)
+#define ProbSwarmOneOf(...) _SwarmOneOf(DEEPFUZZY_CALL_SITE(), DeepFuzzy_SwarmTypeProb, __VA_ARGS__)
 
 #ifndef DEEPFUZZY_PURE_SWARM
 #ifndef DEEPFUZZY_MIXED_SWARM
@@ -338,120 +341,262 @@ inline static void ForAll(Closure func) {
 #endif
 
 #ifdef DEEPFUZZY_PURE_SWARM
-#define OneOf(...) _SwarmOneOf(__FILE__, __LINE__, DeepFuzzy_SwarmTypePure, __VA_ARGS__)
+#define OneOf(...) _SwarmOneOf(DEEPFUZZY_CALL_SITE(), DeepFuzzy_SwarmTypePure, __VA_ARGS__)
 #endif
 
 #ifdef DEEPFUZZY_MIXED_SWARM
-#define OneOf(...) _SwarmOneOf(__FILE__, __LINE__, DeepFuzzy_SwarmTypeMixed, __VA_ARGS__)
+#define OneOf(...) _SwarmOneOf(DEEPFUZZY_CALL_SITE(), DeepFuzzy_SwarmTypeMixed, __VA_ARGS__)
 #endif
 
 #ifdef DEEPFUZZY_PROB_SWARM
-#define OneOf(...) _SwarmOneOf(__FILE__, __LINE__, DeepFuzzy_SwarmTypeProb, __VA_ARGS__)
+#define OneOf(...) _SwarmOneOf(DEEPFUZZY_CALL_SITE(), DeepFuzzy_SwarmTypeProb, __VA_ARGS__)
 #endif
 
+// Compile-time list of indices, for expanding the alternatives of `OneOf`.
+template <size_t... Is>
+struct OneOfIndices {};
+
+template <size_t N, size_t... Is>
+struct MakeOneOfIndices : MakeOneOfIndices<N - 1, N - 1, Is...> {};
+
+template <size_t... Is>
+struct MakeOneOfIndices<0, Is...> {
+  typedef OneOfIndices<Is...> type;
+};
+
+template <typename Tuple, size_t I>
+static void InvokeOneOfAlternative(Tuple &funcs) {
+  std::get<I>(funcs)();
+}
+
+// Call alternative `index` of the tuple of references `funcs` through a
+// static table of invokers, so that choosing needs no allocation or type
+// erasure.
+template <size_t... Is, typename Tuple>
+inline static void CallOneOfAlternative(Tuple &funcs, size_t index,
+                                        OneOfIndices<Is...>) {
+  static void (* const invokers[])(Tuple &) = {
+      &InvokeOneOfAlternative<Tuple, Is>...};
+  invokers[index](funcs);
+}
+
+template <typename... FuncTys>
+inline static void CallOneOf(size_t index, FuncTys&&... funcs) {
+  std::tuple<FuncTys&&...> func_refs(std::forward<FuncTys>(funcs)...);
+  CallOneOfAlternative(func_refs, index,
+                       typename MakeOneOfIndices<sizeof...(FuncTys)>::type());
+}
+
+// Record the start or the end of a `OneOf` among `count` alternatives in the
+// `--trace_reads` trace. `site` is unique to each `OneOf` instantiation.
+inline static void TraceOneOf(enum DeepFuzzy_TraceKind kind, const void *site,
+                              size_t count) {
+  if (DeepFuzzy_TraceReads) {
+    DeepFuzzy_TraceRead(kind, DeepFuzzy_InputIndex, 0,
+                        static_cast<int64_t>(count),
+                        static_cast<uint64_t>(reinterpret_cast<uintptr_t>(site)));
+  }
+}
+
 template <typename... FuncTys>
 inline static void NoSwarmOneOf(FuncTys&&... funcs) {
+  static const char site = 0;
   if (FLAGS_verbose_reads) {
     printf("STARTING OneOf CALL\n");
   }
-  std::function<void(void)> func_arr[sizeof...(FuncTys)] = {funcs...};
+  TraceOneOf(DeepFuzzy_TraceOneOfBegin, &site, sizeof...(funcs));
   unsigned index = DeepFuzzy_UIntInRange(
       0U, static_cast<unsigned>(sizeof...(funcs))-1);
-  func_arr[Pump(index, sizeof...(funcs))]();
+  CallOneOf(Pump(index, sizeof...(funcs)), std::forward<FuncTys>(funcs)...);
   if (FLAGS_verbose_reads) {
     printf("FINISHED OneOf CALL\n");
   }
+  TraceOneOf(DeepFuzzy_TraceOneOfEnd, &site, sizeof...(funcs));
 }
 
 template <typename... FuncTys>
-inline static void _SwarmOneOf(const char* file, unsigned line, enum DeepFuzzy_SwarmType stype,
+inline static void _SwarmOneOf(unsigned site, enum DeepFuzzy_SwarmType stype,
 			       FuncTys&&... funcs) {
   unsigned fcount = static_cast<unsigned>(sizeof...(funcs));
-  std::function<void(void)> func_arr[sizeof...(FuncTys)] = {funcs...};
-  struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_GetSwarmConfig(fcount, file, line, stype);
+  struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_GetSwarmConfigAt(site, fcount, stype);
+  static const char trace_site = 0;
   if (FLAGS_verbose_reads) {
     printf("STARTING OneOf CALL\n");
   }
+  TraceOneOf(DeepFuzzy_TraceOneOfBegin, &trace_site, fcount);
   unsigned index = DeepFuzzy_UIntInRange(0U, sc->fcount-1);
-  func_arr[sc->fmap[Pump(index, sc->fcount)]]();
+  CallOneOf(sc->fmap[Pump(index, sc->fcount)], std::forward<FuncTys>(funcs)...);
   if (FLAGS_verbose_reads) {
     printf("FINISHED OneOf CALL\n");
   }
+  TraceOneOf(DeepFuzzy_TraceOneOfEnd, &trace_site, fcount);
 }
 
-size_t PickIndex(double *probs, size_t length) {
-  double total = 0.0;
-  size_t missing = 0;
-  for (size_t i = 0; i < length; ++i) {
-    if (probs[i] >= 0.0) {
-      total += probs[i];
-    } else{
-      ++missing;
-    }
+// Alias table (Vose's method) for picking indices with given probabilities in
+// constant time, reading one `unsigned` of input per pick. Each `OneOfP` call
+// site has one per number of choices, rebuilt whenever it is given different
+// probabilities than the last time.
+class ProbabilityTable {
+ public:
+  ProbabilityTable(void)
+      : valid(false) {}
+
+  // Number of choices the table was built for, or `0` if it wasn't yet.
+  size_t Size(void) const {
+    return valid ? thresholds.size() : 0;
   }
-  if (total > 1.0) {
-    DeepFuzzy_Abandon("Probabilities sum to more than 1.0");
+
+  // Whether the table was built from the `length` probabilities in `probs`.
+  bool Matches(const double *probs, size_t length) const {
+    return valid && given.size() == length &&
+           std::equal(given.begin(), given.end(), probs);
   }
-  if (missing > 0) {
-    double remainder = (1.0 - total) / missing;
+
+  size_t Pick(void) const {
+    const size_t length = thresholds.size();
+
+    // The high half of `draw * length` selects a column, and the low half is
+    // uniform within it.
+    const uint64_t draw = static_cast<uint64_t>(DeepFuzzy_UInt()) * length;
+    size_t column = static_cast<size_t>(draw >> 32);
+
+    // Under symbolic execution the draw is symbolic, so make the column
+    // concrete on each path before indexing the table with it.
+    if (DeepFuzzy_UsingSymExec) {
+      column = Pump(static_cast<unsigned>(column),
+                    static_cast<unsigned>(length));
+    }
+    if ((draw & 0xFFFFFFFFULL) < thresholds[column]) {
+      return column;
+    }
+    return aliases[column];
+  }
+
+  void Compile(const double *probs, size_t length) {
+    valid = false;
+    given.assign(probs, probs + length);
+    if (!length) {
+      DeepFuzzy_Abandon("No choices to pick from");
+    }
+
+    // Negative probabilities share what the others leave of 1.0.
+    std::vector<double> scaled(probs, probs + length);
+    double total = 0.0;
+    size_t missing = 0;
     for (size_t i = 0; i < length; ++i) {
-      if (probs[i] < 0.0) {
-	probs[i] = remainder;
+      if (scaled[i] >= 0.0) {
+        total += scaled[i];
+      } else {
+        ++missing;
       }
     }
-  } else if (total < 0.999) {
-    DeepFuzzy_Abandon("Total of probabilities is significantly less than 1.0");
+    if (total > 1.0) {
+      DeepFuzzy_Abandon("Probabilities sum to more than 1.0");
+    }
+    if (missing > 0) {
+      double remainder = (1.0 - total) / missing;
+      for (size_t i = 0; i < length; ++i) {
+        if (scaled[i] < 0.0) {
+          scaled[i] = remainder;
+        }
+      }
+      total = 1.0;
+    } else if (total < 0.999) {
+      DeepFuzzy_Abandon("Total of probabilities is significantly less than 1.0");
+    }
+
+    std::vector<size_t> small, large;
+    for (size_t i = 0; i < length; ++i) {
+      scaled[i] = scaled[i] * length / total;
+      (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    thresholds.assign(length, 1ULL << 32);
+    aliases.resize(length);
+    for (size_t i = 0; i < length; ++i) {
+      aliases[i] = i;
+    }
+    while (!small.empty() && !large.empty()) {
+      const size_t less = small.back();
+      const size_t more = large.back();
+      small.pop_back();
+      large.pop_back();
+      thresholds[less] = static_cast<uint64_t>(scaled[less] * 4294967296.0);
+      aliases[less] = more;
+      scaled[more] = (scaled[more] + scaled[less]) - 1.0;
+      (scaled[more] < 1.0 ? small : large).push_back(more);
+    }
+
+    valid = true;
   }
 
-  // We cannot use DeepFuzzy_Float/Double here because the distribution is very bad
-  double P = DeepFuzzy_UIntInRange(0, 10000000)/10000000.0;
-  unsigned index = 0;
-  double sum = 0.0;
-  while ((index < length) && (P > (sum + probs[index]))) {
-    sum += probs[index];
-    index++;
+ private:
+  bool valid;
+  std::vector<double> given;
+  std::vector<uint64_t> thresholds;
+  std::vector<size_t> aliases;
+};
+
+// The alias table of the `OneOfP` at call site `site` that picks among
+// `length` choices. Several `OneOfP`s on one line share a call site, so each
+// site keeps a table per number of choices. Deques keep the tables in place as
+// more are added, e.g. by a nested `OneOfP` while a choice runs.
+inline static ProbabilityTable &SiteProbabilityTable(unsigned site,
+                                                     size_t length) {
+  static std::deque<std::deque<ProbabilityTable>> tables;
+  if (site >= tables.size()) {
+    tables.resize(site + 1);
+  }
+  std::deque<ProbabilityTable> &site_tables = tables[site];
+  ProbabilityTable *unused = nullptr;
+  for (ProbabilityTable &table : site_tables) {
+    if (table.Size() == length) {
+      return table;
+    } else if (!table.Size()) {
+      unused = &table;
+    }
   }
-  return index;
-}
 
-typedef std::function<void(void)> func_t;
+  // Reuse a table whose compilation was abandoned, if any.
+  if (unused) {
+    return *unused;
+  }
+  site_tables.emplace_back();
+  return site_tables.back();
+}
 
-void ActuallySelectSomething(double *probs, func_t *funcs, size_t length) {
+#define OneOfP(...) _OneOfP(DEEPFUZZY_CALL_SITE(), __VA_ARGS__)
+
+// Pick one of the probability/lambda pairs in the tuple `args`, and call it.
+template <size_t... Is, typename Tuple>
+inline static void OneOfPairs(unsigned site, Tuple &args, OneOfIndices<Is...>) {
+  static void (* const invokers[])(Tuple &) = {
+      &InvokeOneOfAlternative<Tuple, 2 * Is + 1>...};
+  ProbabilityTable &table = SiteProbabilityTable(site, sizeof...(Is));
+  double probs[] = {static_cast<double>(std::get<2 * Is>(args))...};
+  if (!table.Matches(probs, sizeof...(Is))) {
+    table.Compile(probs, sizeof...(Is));
+  }
   if (FLAGS_verbose_reads) {
     printf("STARTING OneOf CALL\n");
   }
-
-  funcs[PickIndex(probs, length)]();
+  TraceOneOf(DeepFuzzy_TraceOneOfBegin, &table, sizeof...(Is));
+  invokers[table.Pick()](args);
   if (FLAGS_verbose_reads) {
     printf("FINISHED OneOf CALL\n");
   }
-}
-
-// These two helper functions participate in the splitting.
-// Base case does nothing
-void SplitArgs(double* probs, func_t *funcs) {
-}
-
-// recursive case
-template<typename TyFunc, typename... Rest>
-void SplitArgs(double* probs, func_t *funcs, double firstProb, TyFunc &&firstFunc, Rest &&... rest) {
-  *probs = firstProb;
-  *funcs = firstFunc;
-  SplitArgs(probs + 1, funcs + 1, std::forward<Rest>(rest)...);
+  TraceOneOf(DeepFuzzy_TraceOneOfEnd, &table, sizeof...(Is));
 }
 
 // The entry point for OneOfP over lambdas
 template<typename... Args>
-void OneOfP(Args &&... args) {
+void _OneOfP(unsigned site, Args &&... args) {
   constexpr auto argsLen = sizeof...(Args);
   static_assert((argsLen % 2) == 0, "OneOfP expects probability/lambda pairs");
   constexpr auto length = argsLen / 2;
 
-  double probs[length];
-  func_t funcs[length];
-  SplitArgs(probs, funcs, std::forward<Args>(args)...);
-
-  ActuallySelectSomething(probs, funcs, length);
+  std::tuple<Args&&...> arg_refs(std::forward<Args>(args)...);
+  OneOfPairs(site, arg_refs, typename MakeOneOfIndices<length>::type());
 }
 
 inline static char NoSwarmOneOf(const char *str) {
@@ -461,12 +606,12 @@ inline static char NoSwarmOneOf(const char *str) {
   return str[DeepFuzzy_IntInRange(0, strlen(str) - 1)];
 }
 
-inline static char _SwarmOneOf(const char* file, unsigned line, enum DeepFuzzy_SwarmType stype, const char *str) {
+inline static char _SwarmOneOf(unsigned site, enum DeepFuzzy_SwarmType stype, const char *str) {
   if (!str || !str[0]) {
     DeepFuzzy_Abandon("NULL or empty string passed to OneOf");
   }
   unsigned fcount = strlen(str);
-  struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_GetSwarmConfig(fcount, file, line, stype);
+  struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_GetSwarmConfigAt(site, fcount, stype);
   unsigned index = sc->fmap[DeepFuzzy_UIntInRange(0U, sc->fcount-1)];
   return str[index];
 }
@@ -479,7 +624,9 @@ inline static const T &NoSwarmOneOf(std::vector<T> &arr) {
   return arr[DeepFuzzy_IntInRange(0, arr.size() - 1)];
 }
 
-size_t PickListIndex(std::initializer_list<double> probs, size_t length) {
+inline static size_t PickListIndex(unsigned site,
+                                   std::initializer_list<double> probs,
+                                   size_t length) {
   // The list is interpreted as follows:  a negative probability means "use even distribution"
   // over all probabilities not specified", and the same strategy is used to fill out the list
   // to match the count of items to be chosen among.
@@ -495,25 +642,30 @@ size_t PickListIndex(std::initializer_list<double> probs, size_t length) {
     P[iP++] = -1.0;
   }
 
-  return PickIndex(P, length);
+  ProbabilityTable &table = SiteProbabilityTable(site, length);
+  if (!table.Matches(P, length)) {
+    table.Compile(P, length);
+  }
+  return table.Pick();
 }
 
 template <typename T>
-inline static const T &OneOfP(std::initializer_list<double> probs, std::vector<T> &arr) {
+inline static const T &_OneOfP(unsigned site, std::initializer_list<double> probs,
+                               std::vector<T> &arr) {
   if (arr.empty()) {
     DeepFuzzy_Abandon("Empty vector passed to OneOf");
   }
-  size_t index = PickListIndex(probs, arr.size());
+  size_t index = PickListIndex(site, probs, arr.size());
   return arr[index];
 }
 
 template <typename T>
-inline static const T &_SwarmOneOf(const char* file, unsigned line, enum DeepFuzzy_SwarmType stype, const std::vector<T> &arr) {
+inline static const T &_SwarmOneOf(unsigned site, enum DeepFuzzy_SwarmType stype, const std::vector<T> &arr) {
   if (arr.empty()) {
     DeepFuzzy_Abandon("Empty vector passed to OneOf");
   }
   unsigned fcount = arr.size();
-  struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_GetSwarmConfig(fcount, file, line, stype);
+  struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_GetSwarmConfigAt(site, fcount, stype);
   unsigned index = sc->fmap[DeepFuzzy_UIntInRange(0U, sc->fcount-1)];
   return arr[index];
 }
@@ -527,20 +679,21 @@ inline static const T &NoSwarmOneOf(T (&arr)[len]) {
 }
 
 template <typename T, int len>
-inline static const T &OneOfP(std::initializer_list<double> probs, T (&arr)[len]) {
+inline static const T &_OneOfP(unsigned site, std::initializer_list<double> probs,
+                               T (&arr)[len]) {
   if (!len) {
     DeepFuzzy_Abandon("Empty array passed to OneOf");
   }
-  size_t index = PickListIndex(probs, len);
+  size_t index = PickListIndex(site, probs, len);
   return arr[index];
 }
 
 template <typename T, int len>
-inline static const T &_SwarmOneOf(const char* file, unsigned line, enum DeepFuzzy_SwarmType stype, T (&arr)[len]) {
+inline static const T &_SwarmOneOf(unsigned site, enum DeepFuzzy_SwarmType stype, T (&arr)[len]) {
   if (!len) {
     DeepFuzzy_Abandon("Empty array passed to OneOf");
   }
-  struct DeepFuzzy_SwarmConfig*	sc = DeepFuzzy_GetSwarmConfig(len, file, line, stype);
+  struct DeepFuzzy_SwarmConfig*	sc = DeepFuzzy_GetSwarmConfigAt(site, len, stype);
   unsigned index = sc->fmap[DeepFuzzy_UIntInRange(0U, sc->fcount-1)];
   return arr[index];
 }
@@ -20,6 +20,7 @@
 #include <stdarg.h>
 
 #include <deepfuzzy/Compiler.h>
+#include <deepfuzzy/Option.h>
 
 DEEPFUZZY_BEGIN_EXTERN_C
 
@@ -44,6 +45,29 @@ enum DeepFuzzy_LogLevel {
   DeepFuzzy_LogCritical = DeepFuzzy_LogFatal,
 };
 
+/* Messages below this level are compiled out of harnesses: the C++ `LOG`,
+ * `CHECK`, `ASSERT` and `ASSUME` macros, and `DeepFuzzy_IsLogEnabled`, drop
+ * them without a runtime check. Errors and fatal errors are always logged,
+ * since logging them fails the test. */
+#ifndef DEEPFUZZY_MIN_COMPILED_LOG_LEVEL
+#define DEEPFUZZY_MIN_COMPILED_LOG_LEVEL 0
+#endif
+
+DECLARE_int(min_log_level);
+
+/* Returns non-zero if a message at `level` would be logged, so that callers
+ * can skip formatting messages that are dropped anyway. Symbolic executors
+ * collect messages of every level. */
+DEEPFUZZY_INLINE static int DeepFuzzy_IsLogEnabled(enum DeepFuzzy_LogLevel level) {
+  if (level >= DeepFuzzy_LogError) {
+    return 1;
+  } else if (level < DEEPFUZZY_MIN_COMPILED_LOG_LEVEL) {
+    return 0;
+  }
+  return (int) level >= FLAGS_min_log_level || DeepFuzzy_UsingSymExec ||
+         (DeepFuzzy_UsingLibFuzzer && level == DeepFuzzy_LogDebug);
+}
+
 /* Log a C string. */
 extern void DeepFuzzy_Log(enum DeepFuzzy_LogLevel level, const char *str);
 
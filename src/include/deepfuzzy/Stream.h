@@ -79,6 +79,9 @@ DEEPFUZZY_INLINE static void DeepFuzzy_StreamFloat(
 /* Reset the formatting in a stream. */
 extern void DeepFuzzy_StreamResetFormatting(enum DeepFuzzy_LogLevel level);
 
+/* Clear the contents and reset the formatting of all streams. */
+extern void DeepFuzzy_ResetStreams(void);
+
 DEEPFUZZY_END_EXTERN_C
 
 #endif  /* SRC_INCLUDE_DEEPFUZZY_STREAM_H_ */
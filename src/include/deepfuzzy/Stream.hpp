@@ -25,16 +25,20 @@
 
 namespace deepfuzzy {
 
-/* Conditionally stream output to a log using the streaming APIs. */
+/* Conditionally stream output to a log using the streaming APIs. Nothing is
+ * formatted unless the message will be logged, so in concrete runs a passing
+ * check, or a message below the log level, only costs a branch. */
 class Stream {
  public:
   DEEPFUZZY_INLINE Stream(DeepFuzzy_LogLevel level_, bool do_log_,
                           const char *file, unsigned line)
       : level(level_),
-        do_log(!!DeepFuzzy_IsTrue(do_log_)),
+        do_log(DeepFuzzy_IsLogEnabled(level_) &&
+               (DeepFuzzy_UsingSymExec ? !!DeepFuzzy_IsTrue(do_log_)
+                                       : do_log_)),
         has_something_to_log(false) {
-    DeepFuzzy_LogStream(level);
     if (do_log) {
+      DeepFuzzy_LogStream(level);
       DeepFuzzy_StreamFormat(level, "%s(%u): ", file, line);
     }
   }
@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2019 KhulnaSoft DevOps, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "deepfuzzy/DeepFuzzy.h"
+#include "deepfuzzy/Option.h"
+#include "deepfuzzy/Log.h"
+#include "DeepFuzzy.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+DEEPFUZZY_BEGIN_EXTERN_C
+
+DEFINE_bool(coverage, AnalysisGroup, false, "Use -fsanitize-coverage instrumentation to guide --fuzz.");
+
+enum {
+  kMaxCounterRegions = 64,
+  kMaxStackedMutations = 8,
+  kMaxArithDelta = 35
+};
+
+/* A region of coverage counters, along with the count classes that have been
+ * seen for each counter so far. */
+struct DeepFuzzy_CounterRegion {
+  uint8_t *counters;
+  uint8_t *seen;
+  size_t size;
+};
+
+/* Counters registered by `-fsanitize-coverage=inline-8bit-counters`. */
+static struct DeepFuzzy_CounterRegion DeepFuzzy_CounterRegions[kMaxCounterRegions];
+static unsigned DeepFuzzy_NumCounterRegions = 0;
+
+/* Counters for `-fsanitize-coverage=trace-pc-guard`, indexed by guard. Guard
+ * `0` is reserved for disabled guards. */
+static struct DeepFuzzy_CounterRegion DeepFuzzy_GuardRegion = {NULL, NULL, 0};
+static uint32_t DeepFuzzy_NumGuards = 0;
+
+/* Total number of counters across all regions. */
+static size_t DeepFuzzy_NumCounters = 0;
+
+/* An input that reached new coverage. */
+struct DeepFuzzy_CorpusEntry {
+  uint8_t *data;
+  uint32_t size;
+};
+
+static struct DeepFuzzy_CorpusEntry *DeepFuzzy_Corpus = NULL;
+static uint32_t DeepFuzzy_CorpusSize = 0;
+static uint32_t DeepFuzzy_CorpusCapacity = 0;
+
+/* Number of counters that have been non-zero at least once. */
+static uint32_t DeepFuzzy_NumCountersHit = 0;
+
+/* Maps a hit count to its count class, as in AFL, so that only meaningful
+ * changes in loop iteration counts are treated as new coverage. */
+static uint8_t DeepFuzzy_CountClass[256];
+
+#ifndef LIBFUZZER
+
+/* Fuzzer runtimes, e.g. libFuzzer's, provide their own callbacks, which take
+ * precedence over these weak ones. */
+
+__attribute__((weak))
+void __sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop) {
+  if (start == stop || *start) {
+    return;  /* Already initialized. */
+  }
+
+  uint32_t num_guards = DeepFuzzy_NumGuards + (uint32_t) (stop - start);
+  uint8_t *counters = (uint8_t *) realloc(DeepFuzzy_GuardRegion.counters,
+                                          num_guards + 1);
+  uint8_t *seen = (uint8_t *) realloc(DeepFuzzy_GuardRegion.seen,
+                                      num_guards + 1);
+  if (counters == NULL || seen == NULL) {
+    return;  /* Leave these guards disabled. */
+  }
+
+  memset(&(counters[DeepFuzzy_NumGuards + 1]), 0, stop - start);
+  memset(&(seen[DeepFuzzy_NumGuards + 1]), 0, stop - start);
+  for (uint32_t *guard = start; guard < stop; guard++) {
+    *guard = ++DeepFuzzy_NumGuards;
+  }
+
+  DeepFuzzy_GuardRegion.counters = counters;
+  DeepFuzzy_GuardRegion.seen = seen;
+  DeepFuzzy_GuardRegion.size = num_guards + 1;
+  DeepFuzzy_NumCounters += stop - start;
+}
+
+__attribute__((weak))
+void __sanitizer_cov_trace_pc_guard(uint32_t *guard) {
+  if (*guard) {
+    DeepFuzzy_GuardRegion.counters[*guard]++;
+  }
+}
+
+__attribute__((weak))
+void __sanitizer_cov_8bit_counters_init(uint8_t *start, uint8_t *stop) {
+  if (start == stop || DeepFuzzy_NumCounterRegions == kMaxCounterRegions) {
+    return;
+  }
+
+  uint8_t *seen = (uint8_t *) calloc(stop - start, 1);
+  if (seen == NULL) {
+    return;
+  }
+
+  struct DeepFuzzy_CounterRegion *region =
+      &(DeepFuzzy_CounterRegions[DeepFuzzy_NumCounterRegions++]);
+  region->counters = start;
+  region->seen = seen;
+  region->size = stop - start;
+  DeepFuzzy_NumCounters += stop - start;
+}
+
+/* Required by `inline-8bit-counters` when combined with `pc-table`. */
+__attribute__((weak))
+void __sanitizer_cov_pcs_init(const uintptr_t *pcs_beg,
+                              const uintptr_t *pcs_end) {
+  (void) pcs_beg;
+  (void) pcs_end;
+}
+
+#endif  /* LIBFUZZER */
+
+/* Merge the counts of `region` into the count classes seen so far, and reset
+ * its counters. Returns `true` if a new count class was seen. */
+static bool DeepFuzzy_MergeCounters(struct DeepFuzzy_CounterRegion *region) {
+  bool is_new = false;
+  uint8_t *counters = region->counters;
+  size_t i = 0;
+
+  while (i < region->size) {
+    /* Most counters are zero, so skip over them a word at a time. */
+    if (i + sizeof(uint64_t) <= region->size) {
+      uint64_t word;
+      memcpy(&word, &(counters[i]), sizeof(word));
+      if (!word) {
+        i += sizeof(word);
+        continue;
+      }
+    }
+
+    if (counters[i]) {
+      uint8_t count_class = DeepFuzzy_CountClass[counters[i]];
+      if (count_class & ~region->seen[i]) {
+        if (!region->seen[i]) {
+          DeepFuzzy_NumCountersHit++;
+        }
+        region->seen[i] |= count_class;
+        is_new = true;
+      }
+      counters[i] = 0;
+    }
+    i++;
+  }
+
+  return is_new;
+}
+
+static void DeepFuzzy_ClearCounters(void) {
+  if (DeepFuzzy_GuardRegion.counters) {
+    memset(DeepFuzzy_GuardRegion.counters, 0, DeepFuzzy_GuardRegion.size);
+  }
+  for (unsigned i = 0; i < DeepFuzzy_NumCounterRegions; i++) {
+    memset(DeepFuzzy_CounterRegions[i].counters, 0,
+           DeepFuzzy_CounterRegions[i].size);
+  }
+}
+
+bool DeepFuzzy_InitCoverage(void) {
+  if (!DeepFuzzy_NumCounters) {
+    DeepFuzzy_Log(DeepFuzzy_LogWarning,
+                  "No coverage instrumentation found (build the harness with "
+                  "-fsanitize-coverage=trace-pc-guard or inline-8bit-counters); "
+                  "fuzzing without coverage feedback");
+    return false;
+  }
+
+  DeepFuzzy_CountClass[0] = 0;
+  DeepFuzzy_CountClass[1] = 1;
+  DeepFuzzy_CountClass[2] = 2;
+  DeepFuzzy_CountClass[3] = 4;
+  for (int count = 4; count < 256; count++) {
+    if (count < 8) {
+      DeepFuzzy_CountClass[count] = 8;
+    } else if (count < 16) {
+      DeepFuzzy_CountClass[count] = 16;
+    } else if (count < 32) {
+      DeepFuzzy_CountClass[count] = 32;
+    } else if (count < 128) {
+      DeepFuzzy_CountClass[count] = 64;
+    } else {
+      DeepFuzzy_CountClass[count] = 128;
+    }
+  }
+
+  /* Don't count whatever ran before fuzzing as coverage of the first test. */
+  DeepFuzzy_ClearCounters();
+  return true;
+}
+
+/* Return a random number in `[0, n)`. */
+static uint32_t DeepFuzzy_CoverageRandom(uint32_t n) {
+  return (uint32_t) (((DeepFuzzy_FuzzRandom() >> 32) * n) >> 32);
+}
+
+/* Apply one random mutation to the first `*size` bytes of `data`, which has
+ * room for `DeepFuzzy_InputSize` bytes. */
+static void DeepFuzzy_Mutate(uint8_t *data, uint32_t *size) {
+  static const int8_t interesting_8[] = {-128, -1, 0, 1, 16, 32, 64, 100, 127};
+  static const int16_t interesting_16[] = {-32768, -129, 128, 255, 256, 512,
+                                           1000, 1024, 4096, 32767};
+  static const int32_t interesting_32[] = {INT32_MIN, -100663046, -32769,
+                                           32768, 65535, 65536, 100663045,
+                                           INT32_MAX};
+  uint32_t n = *size;
+  uint32_t pos = DeepFuzzy_CoverageRandom(n);
+
+  switch (DeepFuzzy_CoverageRandom(8)) {
+    case 0:  /* Flip a bit. */
+      data[pos] ^= (uint8_t) (1 << DeepFuzzy_CoverageRandom(8));
+      break;
+
+    case 1:  /* Set a random byte. */
+      data[pos] = (uint8_t) DeepFuzzy_FuzzRandom();
+      break;
+
+    case 2: {  /* Add or subtract a small value. */
+      uint8_t delta = (uint8_t) (1 + DeepFuzzy_CoverageRandom(kMaxArithDelta));
+      data[pos] += DeepFuzzy_CoverageRandom(2) ? delta : -delta;
+      break;
+    }
+
+    case 3: {  /* Overwrite with an interesting value, in either byte order. */
+      uint32_t value = 0;
+      uint32_t width = 1;
+      switch (DeepFuzzy_CoverageRandom(3)) {
+        case 0:
+          value = (uint8_t) interesting_8[DeepFuzzy_CoverageRandom(
+              sizeof(interesting_8) / sizeof(interesting_8[0]))];
+          break;
+        case 1:
+          value = (uint16_t) interesting_16[DeepFuzzy_CoverageRandom(
+              sizeof(interesting_16) / sizeof(interesting_16[0]))];
+          width = 2;
+          break;
+        default:
+          value = (uint32_t) interesting_32[DeepFuzzy_CoverageRandom(
+              sizeof(interesting_32) / sizeof(interesting_32[0]))];
+          width = 4;
+          break;
+      }
+      if (pos + width > n) {
+        width = n - pos;
+      }
+      int big_endian = DeepFuzzy_CoverageRandom(2);
+      for (uint32_t i = 0; i < width; i++) {
+        uint32_t shift = 8 * (big_endian ? (width - 1 - i) : i);
+        data[pos + i] = (uint8_t) (value >> shift);
+      }
+      break;
+    }
+
+    case 4: {  /* Copy a block of the input over another part of it. */
+      uint32_t dst = DeepFuzzy_CoverageRandom(n);
+      uint32_t len = 1 + DeepFuzzy_CoverageRandom(n - (pos > dst ? pos : dst));
+      memmove(&(data[dst]), &(data[pos]), len);
+      break;
+    }
+
+    case 5: {  /* Splice in the tail of another corpus entry. */
+      struct DeepFuzzy_CorpusEntry *other =
+          &(DeepFuzzy_Corpus[DeepFuzzy_CoverageRandom(DeepFuzzy_CorpusSize)]);
+      uint32_t from = DeepFuzzy_CoverageRandom(other->size);
+      uint32_t len = other->size - from;
+      if (pos + len > DeepFuzzy_InputSize) {
+        len = DeepFuzzy_InputSize - pos;
+      }
+      memcpy(&(data[pos]), &(other->data[from]), len);
+      *size = pos + len;
+      break;
+    }
+
+    case 6:  /* Truncate, so that the rest of the input is generated anew. */
+      *size = pos + 1;
+      break;
+
+    default: {  /* Swap two bytes. */
+      uint32_t other_pos = DeepFuzzy_CoverageRandom(n);
+      uint8_t byte = data[pos];
+      data[pos] = data[other_pos];
+      data[other_pos] = byte;
+      break;
+    }
+  }
+}
+
+void DeepFuzzy_CoverageMutateInput(void) {
+  /* Sometimes generate a completely random input, so that the fuzzer does not
+   * get stuck on a small corpus. */
+  if (!DeepFuzzy_CorpusSize || !DeepFuzzy_CoverageRandom(16)) {
+    return;
+  }
+
+  struct DeepFuzzy_CorpusEntry *entry =
+      &(DeepFuzzy_Corpus[DeepFuzzy_CoverageRandom(DeepFuzzy_CorpusSize)]);
+  uint8_t *data = (uint8_t *) DeepFuzzy_Input;
+  uint32_t size = entry->size;
+  memcpy(data, entry->data, size);
+
+  uint32_t num_mutations = 1 + DeepFuzzy_CoverageRandom(kMaxStackedMutations);
+  for (uint32_t i = 0; i < num_mutations; i++) {
+    DeepFuzzy_Mutate(data, &size);
+  }
+
+  /* Bytes read past the mutated input are generated randomly. */
+  DeepFuzzy_InputInitialized = size;
+}
+
+/* Add the input consumed by the last test to the corpus. */
+static void DeepFuzzy_AddToCorpus(void) {
+  if (DeepFuzzy_CorpusSize == DeepFuzzy_CorpusCapacity) {
+    uint32_t capacity = DeepFuzzy_CorpusCapacity ? 2 * DeepFuzzy_CorpusCapacity : 64;
+    struct DeepFuzzy_CorpusEntry *corpus = (struct DeepFuzzy_CorpusEntry *)
+        realloc(DeepFuzzy_Corpus, capacity * sizeof(struct DeepFuzzy_CorpusEntry));
+    if (corpus == NULL) {
+      return;
+    }
+    DeepFuzzy_Corpus = corpus;
+    DeepFuzzy_CorpusCapacity = capacity;
+  }
+
+  uint8_t *data = (uint8_t *) malloc(DeepFuzzy_InputIndex);
+  if (data == NULL) {
+    return;
+  }
+  memcpy(data, (void *) DeepFuzzy_Input, DeepFuzzy_InputIndex);
+  DeepFuzzy_Corpus[DeepFuzzy_CorpusSize].data = data;
+  DeepFuzzy_Corpus[DeepFuzzy_CorpusSize].size = DeepFuzzy_InputIndex;
+  DeepFuzzy_CorpusSize++;
+}
+
+bool DeepFuzzy_CoverageUpdate(enum DeepFuzzy_TestRunResult result) {
+  bool is_new = false;
+  if (DeepFuzzy_GuardRegion.counters) {
+    is_new |= DeepFuzzy_MergeCounters(&DeepFuzzy_GuardRegion);
+  }
+  for (unsigned i = 0; i < DeepFuzzy_NumCounterRegions; i++) {
+    is_new |= DeepFuzzy_MergeCounters(&(DeepFuzzy_CounterRegions[i]));
+  }
+
+  /* Inputs that consumed nothing can't be mutated. */
+  if (!is_new || !DeepFuzzy_InputIndex) {
+    return false;
+  }
+
+  DeepFuzzy_AddToCorpus();
+
+  /* Failing tests are already saved, and so are all passing ones with
+   * `--fuzz_save_passing`. */
+  if (HAS_FLAG_output_test_dir && result == DeepFuzzy_TestRunPass &&
+      !FLAGS_fuzz_save_passing) {
+    DeepFuzzy_SavePassingTest();
+  }
+  return true;
+}
+
+void DeepFuzzy_LogCoverageStats(void) {
+  DeepFuzzy_LogFormat(DeepFuzzy_LogInfo,
+                      "Coverage: %u inputs in corpus, %u of %zu counters hit",
+                      DeepFuzzy_CorpusSize, DeepFuzzy_NumCountersHit,
+                      DeepFuzzy_NumCounters);
+}
+
+DEEPFUZZY_END_EXTERN_C
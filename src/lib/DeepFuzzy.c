@@ -20,6 +20,7 @@
 #include "DeepFuzzy.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <limits.h>
 #include <setjmp.h>
 #include <stdio.h>
@@ -38,15 +39,20 @@ DEFINE_string(input_test_file, InputOutputGroup, "", "Saved test to run.");
 DEFINE_string(input_test_files_dir, InputOutputGroup, "", "Directory of saved test files to run (flat structure).");
 DEFINE_string(output_test_dir, InputOutputGroup, "", "Directory where tests will be saved.");
 DEFINE_bool(input_stdin, InputOutputGroup, false, "Run a test from stdin.");
+DEFINE_uint(max_input_size, InputOutputGroup, DEEPFUZZY_SIZE, "Maximum number of input bytes a test can read.");
 
 /* Test execution-related options, configures how an execution run is carried out */
 DEFINE_bool(take_over, ExecutionGroup, false, "Replay test cases in take-over mode.");
 DEFINE_bool(abort_on_fail, ExecutionGroup, false, "Abort on file replay failure (useful in file fuzzing).");
 DEFINE_bool(exit_on_fail, ExecutionGroup, false, "Exit with status 255 on test failure.");
 DEFINE_bool(verbose_reads, ExecutionGroup, false, "Report on bytes being read during execution of test.");
+DEFINE_bool(compact_encoding, InputOutputGroup, false, "Read booleans and integers in a range from only as many input bits as they need.");
 DEFINE_int(min_log_level, ExecutionGroup, 0, "Minimum level of logging to output (default 0, 0=debug, 1=trace, 2=info, ...).");
 DEFINE_int(timeout, ExecutionGroup, 3600, "Timeout for brute force fuzzing.");
 DEFINE_uint(num_workers, ExecutionGroup, 1, "Number of workers to spawn for testing and test generation.");
+DEFINE_bool(check_reset, ExecutionGroup, false, "Run each in-process test twice to check that no state leaks between runs.");
+DEFINE_uint(rss_limit_mb, ExecutionGroup, 0, "Limit the address space of forked tests to this many megabytes, and treat tests that exceed it as out of memory (0 for no limit).");
+DEFINE_uint(exec_timeout_ms, ExecutionGroup, 0, "Stop a test that runs for longer than this many milliseconds, and treat it as hanging (0 for no limit).");
 #if defined(_WIN32) || defined(_MSC_VER)
 DEFINE_bool(direct_run, ExecutionGroup, false, "Run test function directly.");
 #endif
@@ -55,6 +61,10 @@ DEFINE_bool(direct_run, ExecutionGroup, false, "Run test function directly.");
 DEFINE_bool(fuzz, AnalysisGroup, false, "Perform brute force unguided fuzzing.");
 DEFINE_bool(fuzz_save_passing, AnalysisGroup, false, "Save passing tests during fuzzing.");
 DEFINE_bool(fork, AnalysisGroup, true, "Fork when running a test.");
+DEFINE_bool(fork_server, AnalysisGroup, false, "Fork each test from a fork server started after setup, instead of from the harness.");
+DEFINE_uint(max_saves_per_bucket, AnalysisGroup, 0, "Save at most this many failing or crashing tests per failure location or crash site when fuzzing (0 for no limit).");
+DEFINE_bool(save_smallest_per_bucket, AnalysisGroup, false, "Keep only the smallest failing or crashing test per failure location or crash site when fuzzing.");
+DEFINE_uint(fuzz_stats_interval, AnalysisGroup, 30, "Seconds between fuzzing status reports (0 to only report when done).");
 DEFINE_int(seed, AnalysisGroup, 0, "Seed for brute force fuzzing (uses time if not set).");
 
 /* Test selection options to configure what test or tests should be executed during a run */
@@ -73,10 +83,11 @@ int DeepFuzzy_UsingLibFuzzer = 0;
 /* To make libFuzzer louder on mac OS. */
 int DeepFuzzy_LibFuzzerLoud = 0;
 
-/* Array of DeepFuzzy generated allocations.  Impossible for there to
- * be more than there are input bytes.  Index stores where we are. */
-char* DeepFuzzy_GeneratedAllocs[DeepFuzzy_InputSize];
+/* Array of DeepFuzzy generated allocations, grown as needed.  Index stores
+ * where we are. */
+char **DeepFuzzy_GeneratedAllocs = NULL;
 uint32_t DeepFuzzy_GeneratedAllocsIndex = 0;
+static uint32_t DeepFuzzy_GeneratedAllocsCapacity = 0;
 
 /* Pointer to the last registers DeepFuzzy_TestInfo data structure */
 struct DeepFuzzy_TestInfo *DeepFuzzy_LastTestInfo = NULL;
@@ -87,21 +98,70 @@ struct DeepFuzzy_TestInfo *DeepFuzzy_FirstTestInfo = NULL;
 /* Pointer to the test being run in this process by Dr. Fuzz. */
 static struct DeepFuzzy_TestInfo *DeepFuzzy_DrFuzzTest = NULL;
 
-/* Initialize global input buffer and index / initialized index. */
-volatile uint8_t DeepFuzzy_Input[DeepFuzzy_InputSize] = {};
+/* Initialize global input buffer and index / initialized index. The static
+ * buffer is what the symbolic executors find through the `InputBegin` and
+ * `InputEnd` API entries. */
+static volatile uint8_t DeepFuzzy_StaticInput[DEEPFUZZY_SIZE] = {};
+volatile uint8_t *DeepFuzzy_Input = DeepFuzzy_StaticInput;
+uint32_t DeepFuzzy_InputSize = DEEPFUZZY_SIZE;
 uint32_t DeepFuzzy_InputIndex = 0;
 uint32_t DeepFuzzy_InputInitialized = 0;
 
+/* The bit cursor of the compact encoding: the input byte it reads from, the
+ * input index right after it, and the number of its bits not yet read. */
+static uint8_t DeepFuzzy_BitCursorByte = 0;
+static uint32_t DeepFuzzy_BitCursorIndex = 0;
+static unsigned DeepFuzzy_BitCursorBitsLeft = 0;
+
 /* Used if we need to generate on-the-fly data while we fuzz */
 uint32_t DeepFuzzy_InternalFuzzing = 0;
 
-/* Swarm related state. */
+int DeepFuzzy_TestMemoryLimited = 0;
+
+/* State of the xoshiro256** generators used by the built-in fuzzer. The seed
+ * generator is seeded once per worker, and seeds the input generator anew for
+ * each test, so that each test's input only depends on `--seed`, the worker,
+ * and the number of tests before it. */
+static uint64_t DeepFuzzy_FuzzSeedState[4];
+static uint64_t DeepFuzzy_FuzzInputState[4];
+
+/* Swarm related state. Configurations only live for one test, and are
+ * discarded by resetting `DeepFuzzy_SwarmConfigsIndex`; their fmaps are
+ * packed into one buffer that is reused across tests. */
 uint32_t DeepFuzzy_SwarmConfigsIndex = 0;
-struct DeepFuzzy_SwarmConfig *DeepFuzzy_SwarmConfigs[DEEPFUZZY_MAX_SWARM_CONFIGS];
+static struct DeepFuzzy_SwarmConfig DeepFuzzy_SwarmConfigs[DEEPFUZZY_MAX_SWARM_CONFIGS];
+static unsigned *DeepFuzzy_SwarmFmaps = NULL;
+static size_t DeepFuzzy_SwarmFmapsCapacity = 0;
+
+/* Call sites registered by `DeepFuzzy_RegisterCallSite`, with an open
+ * addressing table of their IDs plus one, indexed by a hash of their file name
+ * and line. For each call site, the index of its last swarm configuration,
+ * which is only valid if that configuration exists and is of this site. */
+struct DeepFuzzy_CallSite {
+  const char *file;
+  unsigned line;
+};
+#define DEEPFUZZY_CALL_SITE_TABLE_SIZE (2 * DEEPFUZZY_MAX_CALL_SITES)
+static struct DeepFuzzy_CallSite DeepFuzzy_CallSites[DEEPFUZZY_MAX_CALL_SITES];
+static unsigned DeepFuzzy_NumCallSites = 0;
+static unsigned DeepFuzzy_CallSiteTable[DEEPFUZZY_CALL_SITE_TABLE_SIZE];
+static unsigned DeepFuzzy_CallSiteSwarmConfig[DEEPFUZZY_MAX_CALL_SITES];
 
 /* Jump buffer for returning to `DeepFuzzy_Run`. */
 jmp_buf DeepFuzzy_ReturnToRun = {};
 
+/* Functions that reset harness-defined state between in-process tests. */
+static DeepFuzzy_ResetFunc DeepFuzzy_ResetFuncs[DEEPFUZZY_MAX_RESET_FUNCS];
+static unsigned DeepFuzzy_NumResetFuncs = 0;
+
+/* Set while re-running a test for `--check_reset`, so that it isn't saved
+ * twice. */
+static int DeepFuzzy_SuppressSaves = 0;
+
+/* Shared table of the distinct failures and crashes seen while fuzzing, used
+ * to limit the number of tests saved for each. */
+static struct DeepFuzzy_SaveBucket *DeepFuzzy_SaveBuckets = NULL;
+
 /* Information about the current test run, if any. */
 extern struct DeepFuzzy_TestRunInfo *DeepFuzzy_CurrentTestRun = NULL;
 
@@ -122,6 +182,17 @@ void DeepFuzzy_InitCurrentTestRun(struct DeepFuzzy_TestInfo *test) {
   DeepFuzzy_CurrentTestRun->test = test;
   DeepFuzzy_CurrentTestRun->result = DeepFuzzy_TestRunPass;
   DeepFuzzy_CurrentTestRun->reason = NULL;
+  DeepFuzzy_CurrentTestRun->fail_location[0] = '\0';
+  DeepFuzzy_CurrentTestRun->crash_signal = 0;
+  DeepFuzzy_CurrentTestRun->crash_pc = 0;
+  DeepFuzzy_CurrentTestRun->out_of_memory = 0;
+  errno = 0;  /* So that `DeepFuzzy_AllocationFailed` only sees this test. */
+  DeepFuzzy_BitCursorBitsLeft = 0;
+  DeepFuzzy_ResetSearchBudget();
+  if (DeepFuzzy_TraceReads) {
+    DeepFuzzy_TraceRead(DeepFuzzy_TraceTestBegin, 0, 0, 0,
+                        (uint64_t) (uintptr_t) test->test_func);
+  }
 }
 
 /* Abandon this test. We've hit some kind of internal problem. */
@@ -162,6 +233,18 @@ void DeepFuzzy_Fail(void) {
   }
 }
 
+/* Stop this test because it ran out of memory. */
+DEEPFUZZY_NORETURN
+void DeepFuzzy_OutOfMemory(void) {
+  DeepFuzzy_CurrentTestRun->result = DeepFuzzy_TestRunOOM;
+
+  if (FLAGS_take_over) {
+    exit(DeepFuzzy_TestRunOOM);
+  } else {
+    longjmp(DeepFuzzy_ReturnToRun, 1);
+  }
+}
+
 /* Mark this test as passing. */
 DEEPFUZZY_NORETURN
 void DeepFuzzy_Pass(void) {
@@ -172,6 +255,96 @@ void DeepFuzzy_SoftFail(void) {
   DeepFuzzy_SetTestFailed();
 }
 
+/* Remember `ptr`, so that it is freed when the test ends. */
+static void DeepFuzzy_AddGeneratedAlloc(char *ptr) {
+  if (DeepFuzzy_GeneratedAllocsIndex == DeepFuzzy_GeneratedAllocsCapacity) {
+    uint32_t capacity = DeepFuzzy_GeneratedAllocsCapacity ?
+                        2 * DeepFuzzy_GeneratedAllocsCapacity : 64;
+    char **allocs = (char **) realloc(DeepFuzzy_GeneratedAllocs,
+                                      capacity * sizeof(char *));
+    if (allocs == NULL) {
+      free(ptr);
+      DeepFuzzy_Abandon("Can't allocate memory");
+    }
+    DeepFuzzy_GeneratedAllocs = allocs;
+    DeepFuzzy_GeneratedAllocsCapacity = capacity;
+  }
+  DeepFuzzy_GeneratedAllocs[DeepFuzzy_GeneratedAllocsIndex++] = ptr;
+}
+
+/* Set by `DeepFuzzy_SelectReadPath` when values can be read from the input
+ * buffer in bulk, rather than one byte at a time. */
+static int DeepFuzzy_FastReads = 0;
+
+int DeepFuzzy_CompactEncoding = 0;
+
+void DeepFuzzy_SelectReadPath(void) {
+  DeepFuzzy_TraceReads = !DeepFuzzy_UsingSymExec && DeepFuzzy_OpenTrace();
+  DeepFuzzy_FastReads = !DeepFuzzy_UsingSymExec && !FLAGS_verbose_reads &&
+                        !DeepFuzzy_TraceReads;
+  DeepFuzzy_CompactEncoding = !DeepFuzzy_UsingSymExec && FLAGS_compact_encoding;
+}
+
+/* Make sure the input bytes up to `end` are initialized the way
+ * `DEEPFUZZY_READBYTE` would: by the built-in fuzzer one block at a time, so
+ * that the same seed produces the same input on either path, or else by
+ * zeroing them. Zeroed bytes count as initialized, so that reading them again
+ * stays on the fast path. */
+static DEEPFUZZY_NOINLINE void DeepFuzzy_InitializeInputTo(uint32_t end) {
+  if (DeepFuzzy_InternalFuzzing) {
+    const uint32_t index = DeepFuzzy_InputIndex;
+    while (DeepFuzzy_InputInitialized < end) {
+      if (DeepFuzzy_InputIndex < DeepFuzzy_InputInitialized) {
+        DeepFuzzy_InputIndex = DeepFuzzy_InputInitialized;
+      }
+      (void) DeepFuzzy_FuzzFillBlock();
+    }
+    DeepFuzzy_InputIndex = index;
+  } else {
+    uint32_t begin = DeepFuzzy_InputIndex;
+    if (begin < DeepFuzzy_InputInitialized) {
+      begin = DeepFuzzy_InputInitialized;
+    }
+    memset((uint8_t *) &(DeepFuzzy_Input[begin]), 0, end - begin);
+    DeepFuzzy_InputInitialized = end;
+  }
+}
+
+/* Consume the next `num_bytes` input bytes, which the caller has checked to be
+ * within the input limit, and return a pointer to them. Only used for concrete
+ * runs. */
+static DEEPFUZZY_INLINE const uint8_t *DeepFuzzy_ConsumeInput(uint32_t num_bytes) {
+  const uint32_t index = DeepFuzzy_InputIndex;
+  const uint32_t end = index + num_bytes;
+  if (DEEPFUZZY_UNLIKELY(end > DeepFuzzy_InputInitialized)) {
+    DeepFuzzy_InitializeInputTo(end);
+  }
+  DeepFuzzy_InputIndex = end;
+  return (const uint8_t *) &(DeepFuzzy_Input[index]);
+}
+
+/* Decode the `size`-byte integer at `bytes`, most significant byte first like
+ * the per-byte path. */
+static DEEPFUZZY_INLINE uint64_t DeepFuzzy_LoadBigEndian(const uint8_t *bytes,
+                                                         size_t size) {
+  uint16_t val16;
+  uint32_t val32;
+  uint64_t val64;
+  switch (size) {
+    case 1:
+      return bytes[0];
+    case 2:
+      memcpy(&val16, bytes, sizeof(val16));
+      return DEEPFUZZY_FROM_BIG_ENDIAN16(val16);
+    case 4:
+      memcpy(&val32, bytes, sizeof(val32));
+      return DEEPFUZZY_FROM_BIG_ENDIAN32(val32);
+    default:
+      memcpy(&val64, bytes, sizeof(val64));
+      return DEEPFUZZY_FROM_BIG_ENDIAN64(val64);
+  }
+}
+
 /* Symbolize the data in the exclusive range `[begin, end)`. */
 void DeepFuzzy_SymbolizeData(void *begin, void *end) {
   uintptr_t begin_addr = (uintptr_t) begin;
@@ -181,17 +354,30 @@ void DeepFuzzy_SymbolizeData(void *begin, void *end) {
     DeepFuzzy_Abandon("Invalid data bounds for DeepFuzzy_SymbolizeData");
   } else if (begin_addr == end_addr) {
     return;
+  } else if (DeepFuzzy_FastReads) {
+    uint8_t *bytes = (uint8_t *) begin;
+    const uintptr_t size = end_addr - begin_addr;
+    if (size > (DeepFuzzy_InputSize - DeepFuzzy_InputIndex)) {
+      DeepFuzzy_Abandon("Exceeded set input limit. Set or expand --max_input_size to write more bytes.");
+    }
+    memcpy(bytes, DeepFuzzy_ConsumeInput((uint32_t) size), size);
   } else {
     uint8_t *bytes = (uint8_t *) begin;
+    const uint32_t offset = DeepFuzzy_InputIndex;
     for (uintptr_t i = 0, max_i = (end_addr - begin_addr); i < max_i; ++i) {
       if (DeepFuzzy_InputIndex >= DeepFuzzy_InputSize) {
-        DeepFuzzy_Abandon("Exceeded set input limit. Set or expand DEEPFUZZY_SIZE to write more bytes.");
+        DeepFuzzy_Abandon("Exceeded set input limit. Set or expand --max_input_size to write more bytes.");
       }
       if (FLAGS_verbose_reads) {
         printf("Reading byte at %u\n", DeepFuzzy_InputIndex);
       }
       bytes[i] = DEEPFUZZY_READBYTE;
     }
+    if (DeepFuzzy_TraceReads) {
+      DeepFuzzy_TraceRead(DeepFuzzy_TraceBytes, offset,
+                          DeepFuzzy_InputIndex - offset, 0,
+                          (uint64_t) (uintptr_t) DEEPFUZZY_RETURN_ADDRESS());
+    }
   }
 }
 
@@ -205,11 +391,24 @@ void DeepFuzzy_SymbolizeDataNoNull(void *begin, void *end) {
     DeepFuzzy_Abandon("Invalid data bounds for DeepFuzzy_SymbolizeData");
   } else if (begin_addr == end_addr) {
     return;
+  } else if (DeepFuzzy_FastReads) {
+    uint8_t *bytes = (uint8_t *) begin;
+    const uintptr_t size = end_addr - begin_addr;
+    if (size > (DeepFuzzy_InputSize - DeepFuzzy_InputIndex)) {
+      DeepFuzzy_Abandon("Exceeded set input limit. Set or expand --max_input_size to write more bytes.");
+    }
+    memcpy(bytes, DeepFuzzy_ConsumeInput((uint32_t) size), size);
+
+    /* Branch-free, so that the compiler can vectorize it. */
+    for (uintptr_t i = 0; i < size; ++i) {
+      bytes[i] += (bytes[i] == 0);
+    }
   } else {
     uint8_t *bytes = (uint8_t *) begin;
+    const uint32_t offset = DeepFuzzy_InputIndex;
     for (uintptr_t i = 0, max_i = (end_addr - begin_addr); i < max_i; ++i) {
       if (DeepFuzzy_InputIndex >= DeepFuzzy_InputSize) {
-        DeepFuzzy_Abandon("Exceeded set input limit. Set or expand DEEPFUZZY_SIZE to write more bytes.");
+        DeepFuzzy_Abandon("Exceeded set input limit. Set or expand --max_input_size to write more bytes.");
       }
       if (FLAGS_verbose_reads) {
         printf("Reading byte at %u\n", DeepFuzzy_InputIndex);
@@ -219,6 +418,11 @@ void DeepFuzzy_SymbolizeDataNoNull(void *begin, void *end) {
         bytes[i] = 1;
       }
     }
+    if (DeepFuzzy_TraceReads) {
+      DeepFuzzy_TraceRead(DeepFuzzy_TraceCStr, offset,
+                          DeepFuzzy_InputIndex - offset, 0,
+                          (uint64_t) (uintptr_t) DEEPFUZZY_RETURN_ADDRESS());
+    }
   }
 }
 
@@ -227,6 +431,81 @@ void *DeepFuzzy_ConcretizeData(void *begin, void *end) {
   return begin;
 }
 
+/* All non-null characters, used by the swarm string generators when no
+ * characters are given. */
+static char DeepFuzzy_AllChars[256];
+static uint32_t DeepFuzzy_NumAllChars = 0;
+
+static const char *DeepFuzzy_SwarmAllowed(const char *allowed) {
+  if (allowed) {
+    return allowed;
+  }
+  if (!DeepFuzzy_NumAllChars) {
+    for (int i = 0; i < 255; i++) {
+      DeepFuzzy_AllChars[i] = (char) (i + 1);
+    }
+    DeepFuzzy_AllChars[255] = '\0';
+    DeepFuzzy_NumAllChars = 255;
+  }
+  return DeepFuzzy_AllChars;
+}
+
+/* Fill `str[0, len)` with characters of the `allowed_size` long `allowed`,
+ * restricted to those in the fmap of `sc`, if given. All the input bytes are
+ * read at once, and each byte `b` picks choice `(b * num_choices) >> 8`, so a
+ * character costs one input byte. That is only close to uniform if the number
+ * of choices divides 256 or is small: e.g. of 95 choices, 66 would get three
+ * of the 256 byte values and 29 only two. Otherwise, each character takes two
+ * bytes instead, and no choice is more than 1/256 likelier than another. */
+static void DeepFuzzy_GenerateChars(char *str, size_t len, const char *allowed,
+                                    uint32_t allowed_size,
+                                    const struct DeepFuzzy_SwarmConfig *sc) {
+  if (!len) {
+    return;
+  }
+  if (!allowed_size) {
+    DeepFuzzy_Abandon("No allowed characters to generate a string from.");
+  }
+
+  const unsigned *fmap = sc ? sc->fmap : NULL;
+  const uint32_t num_choices = sc ? sc->fcount : allowed_size;
+  uint8_t *bytes = (uint8_t *) str;
+
+  if ((256 % num_choices) && num_choices > 16) {
+    for (size_t i = 0; i < len; i++) {
+      uint32_t choice = ((uint32_t) DeepFuzzy_UShort() * num_choices) >> 16;
+      bytes[i] = (uint8_t) allowed[fmap ? fmap[choice] : choice];
+    }
+    return;
+  }
+
+  DeepFuzzy_SymbolizeData(bytes, &(bytes[len]));
+  if (fmap) {
+    for (size_t i = 0; i < len; i++) {
+      bytes[i] = (uint8_t) allowed[fmap[(bytes[i] * num_choices) >> 8]];
+    }
+  } else {
+    for (size_t i = 0; i < len; i++) {
+      bytes[i] = (uint8_t) allowed[(bytes[i] * num_choices) >> 8];
+    }
+  }
+}
+
+/* Generate `len` characters for a swarm string generator at `line` of
+ * `file`. */
+static void DeepFuzzy_SwarmGenerateChars(const char *file, unsigned line,
+                                         int stype, char *str, size_t len,
+                                         const char *allowed) {
+  if (len) {
+    allowed = DeepFuzzy_SwarmAllowed(allowed);
+    uint32_t allowed_size = (allowed == DeepFuzzy_AllChars) ?
+                            DeepFuzzy_NumAllChars : (uint32_t) strlen(allowed);
+    struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_GetSwarmConfig(
+        allowed_size, file, line, (enum DeepFuzzy_SwarmType) stype);
+    DeepFuzzy_GenerateChars(str, len, allowed, allowed_size, sc);
+  }
+}
+
 /* Assign a symbolic C string of strlen length `len`.  str should include
  * storage for both `len` characters AND the null terminator.  Allowed
  * is a set of chars that are allowed (ignored if null). */
@@ -241,10 +520,7 @@ void DeepFuzzy_AssignCStr_C(char* str, size_t len, const char* allowed) {
     if (allowed == 0) {
       DeepFuzzy_SymbolizeDataNoNull(str, &(str[len]));
     } else {
-      uint32_t allowed_size = strlen(allowed);
-      for (int i = 0; i < len; i++) {
-        str[i] = allowed[DeepFuzzy_UIntInRange(0, allowed_size-1)];
-      }
+      DeepFuzzy_GenerateChars(str, len, allowed, strlen(allowed), NULL);
     }
   }
   str[len] = '\0';
@@ -258,22 +534,7 @@ void DeepFuzzy_SwarmAssignCStr_C(const char* file, unsigned line, int stype,
   if (NULL == str) {
     DeepFuzzy_Abandon("Attempted to populate null pointer.");
   }
-  char swarm_allowed[256];  
-  if (allowed == 0) {
-    /* In swarm mode, if there is no allowed string, create one over all chars. */
-    for (int i = 0; i < 255; i++) {
-      swarm_allowed[i] = i+1;
-    }
-    swarm_allowed[255] = 0;
-    allowed = (const char*)&swarm_allowed;
-  }
-  if (len) {
-    uint32_t allowed_size = strlen(allowed);
-    struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_GetSwarmConfig(allowed_size, file, line, stype);
-    for (int i = 0; i < len; i++) {
-      str[i] = allowed[sc->fmap[DeepFuzzy_UIntInRange(0U, sc->fcount-1)]];
-    }
-  }
+  DeepFuzzy_SwarmGenerateChars(file, line, stype, str, len, allowed);
   str[len] = '\0';
 }
 
@@ -286,15 +547,12 @@ char *DeepFuzzy_CStr_C(size_t len, const char* allowed) {
   if (NULL == str) {
     DeepFuzzy_Abandon("Can't allocate memory");
   }
-  DeepFuzzy_GeneratedAllocs[DeepFuzzy_GeneratedAllocsIndex++] = str;
+  DeepFuzzy_AddGeneratedAlloc(str);
   if (len) {
     if (allowed == 0) {
       DeepFuzzy_SymbolizeDataNoNull(str, &(str[len]));
     } else {
-      uint32_t allowed_size = strlen(allowed);
-      for (int i = 0; i < len; i++) {
-        str[i] = allowed[DeepFuzzy_UIntInRange(0, allowed_size-1)];
-      }
+      DeepFuzzy_GenerateChars(str, len, allowed, strlen(allowed), NULL);
     }
   }
   str[len] = '\0';
@@ -310,23 +568,8 @@ char *DeepFuzzy_SwarmCStr_C(const char* file, unsigned line, int stype,
   if (NULL == str) {
     DeepFuzzy_Abandon("Can't allocate memory");
   }
-  char swarm_allowed[256];  
-  if (allowed == 0) {
-    /* In swarm mode, if there is no allowed string, create one over all chars. */
-    for (int i = 0; i < 255; i++) {
-      swarm_allowed[i] = i+1;
-    }
-    swarm_allowed[255] = 0;
-    allowed = (const char*)&swarm_allowed;
-  }
-  DeepFuzzy_GeneratedAllocs[DeepFuzzy_GeneratedAllocsIndex++] = str;
-  if (len) {
-    uint32_t allowed_size = strlen(allowed);
-    struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_GetSwarmConfig(allowed_size, file, line, stype);
-    for (int i = 0; i < len; i++) {
-      str[i] = allowed[sc->fmap[DeepFuzzy_UIntInRange(0U, sc->fcount-1)]];
-    }
-  }
+  DeepFuzzy_AddGeneratedAlloc(str);
+  DeepFuzzy_SwarmGenerateChars(file, line, stype, str, len, allowed);
   str[len] = '\0';
   return str;
 }
@@ -337,13 +580,7 @@ void DeepFuzzy_SymbolizeCStr_C(char *begin, const char* allowed) {
     if (allowed == 0) {
       DeepFuzzy_SymbolizeDataNoNull(begin, begin + strlen(begin));
     } else {
-      uint32_t allowed_size = strlen(allowed);
-      uint8_t *bytes = (uint8_t *) begin;
-      uintptr_t begin_addr = (uintptr_t) begin;
-      uintptr_t end_addr = (uintptr_t) (begin + strlen(begin));
-      for (uintptr_t i = 0, max_i = (end_addr - begin_addr); i < max_i; ++i) {
-        bytes[i] = allowed[DeepFuzzy_UIntInRange(0, allowed_size-1)];
-      }
+      DeepFuzzy_GenerateChars(begin, strlen(begin), allowed, strlen(allowed), NULL);
     }
   }
 }
@@ -351,23 +588,7 @@ void DeepFuzzy_SymbolizeCStr_C(char *begin, const char* allowed) {
 void DeepFuzzy_SwarmSymbolizeCStr_C(const char* file, unsigned line, int stype,
 				    char *begin, const char* allowed) {
   if (begin && begin[0]) {
-    char swarm_allowed[256];    
-    if (allowed == 0) {
-      /* In swarm mode, if there is no allowed string, create one over all chars. */
-      for (int i = 0; i < 255; i++) {
-	swarm_allowed[i] = i+1;
-      }
-      swarm_allowed[255] = 0;
-      allowed = (const char*)&swarm_allowed;      
-    }
-    uint32_t allowed_size = strlen(allowed);
-    struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_GetSwarmConfig(allowed_size, file, line, stype);
-    uint8_t *bytes = (uint8_t *) begin;
-    uintptr_t begin_addr = (uintptr_t) begin;
-    uintptr_t end_addr = (uintptr_t) (begin + strlen(begin));
-    for (uintptr_t i = 0, max_i = (end_addr - begin_addr); i < max_i; ++i) {
-      bytes[i] = allowed[sc->fmap[DeepFuzzy_UIntInRange(0U, sc->fcount-1)]];
-    }
+    DeepFuzzy_SwarmGenerateChars(file, line, stype, begin, strlen(begin), allowed);
   }
 }
 
@@ -389,7 +610,7 @@ void *DeepFuzzy_GCMalloc(size_t num_bytes) {
   void *data = malloc(num_bytes);
   uintptr_t data_end = ((uintptr_t) data) + num_bytes;
   DeepFuzzy_SymbolizeData(data, (void *) data_end);
-  DeepFuzzy_GeneratedAllocs[DeepFuzzy_GeneratedAllocsIndex++] = data;
+  DeepFuzzy_AddGeneratedAlloc((char *) data);
   return data;
 }
 
@@ -402,18 +623,89 @@ void *DeepFuzzy_MemScrub(void *pointer, size_t data_size) {
   return pointer;
 }
 
+unsigned DeepFuzzy_RegisterCallSite(const char *file, unsigned line) {
+  /* FNV-1a. */
+  uint64_t hash = 0xcbf29ce484222325ULL ^ line;
+  for (const char *c = file; *c; c++) {
+    hash = (hash ^ (uint8_t) *c) * 0x100000001b3ULL;
+  }
+
+  unsigned slot = (unsigned) (hash ^ (hash >> 32)) % DEEPFUZZY_CALL_SITE_TABLE_SIZE;
+  for (; DeepFuzzy_CallSiteTable[slot];
+       slot = (slot + 1) % DEEPFUZZY_CALL_SITE_TABLE_SIZE) {
+    const unsigned site = DeepFuzzy_CallSiteTable[slot] - 1;
+    if (DeepFuzzy_CallSites[site].line == line &&
+        strcmp(DeepFuzzy_CallSites[site].file, file) == 0) {
+      return site;
+    }
+  }
+
+  if (DeepFuzzy_NumCallSites == DEEPFUZZY_MAX_CALL_SITES) {
+    DeepFuzzy_Log(DeepFuzzy_LogError,
+                  "Exceeded call site limit. Set or expand DEEPFUZZY_MAX_CALL_SITES.");
+    exit(1);
+  }
+  /* Keep our own copy of the file name, as swarm configurations hand it out
+   * long after the caller's string may be gone. */
+  char *file_copy = strdup(file);
+  if (file_copy == NULL) {
+    DeepFuzzy_OutOfMemory();
+  }
+  const unsigned site = DeepFuzzy_NumCallSites++;
+  DeepFuzzy_CallSites[site].file = file_copy;
+  DeepFuzzy_CallSites[site].line = line;
+  DeepFuzzy_CallSiteSwarmConfig[site] = DEEPFUZZY_MAX_SWARM_CONFIGS;
+  DeepFuzzy_CallSiteTable[slot] = site + 1;
+  return site;
+}
+
+/* Return space for an fmap of `size` entries after those of the current
+ * swarm configurations. */
+static unsigned *DeepFuzzy_AllocSwarmFmap(size_t size) {
+  size_t used = 0;
+  if (DeepFuzzy_SwarmConfigsIndex) {
+    const struct DeepFuzzy_SwarmConfig *last =
+        &(DeepFuzzy_SwarmConfigs[DeepFuzzy_SwarmConfigsIndex - 1]);
+    used = (size_t) (last->fmap - DeepFuzzy_SwarmFmaps) + last->fcount;
+  }
+
+  if (used + size > DeepFuzzy_SwarmFmapsCapacity) {
+    size_t capacity = DeepFuzzy_SwarmFmapsCapacity ? DeepFuzzy_SwarmFmapsCapacity : 1024;
+    while (capacity < used + size) {
+      capacity *= 2;
+    }
+    /* Copy rather than `realloc`, so that the configurations can be rebased
+     * while their old fmaps are still valid. */
+    unsigned *fmaps = (unsigned *) malloc(capacity * sizeof(unsigned));
+    if (fmaps == NULL) {
+      DeepFuzzy_OutOfMemory();
+    }
+    if (used) {
+      memcpy(fmaps, DeepFuzzy_SwarmFmaps, used * sizeof(unsigned));
+    }
+    for (uint32_t i = 0; i < DeepFuzzy_SwarmConfigsIndex; i++) {
+      DeepFuzzy_SwarmConfigs[i].fmap =
+          fmaps + (DeepFuzzy_SwarmConfigs[i].fmap - DeepFuzzy_SwarmFmaps);
+    }
+    free(DeepFuzzy_SwarmFmaps);
+    DeepFuzzy_SwarmFmaps = fmaps;
+    DeepFuzzy_SwarmFmapsCapacity = capacity;
+  }
+
+  return DeepFuzzy_SwarmFmaps + used;
+}
+
 /* Generate a new swarm configuration. */
-struct DeepFuzzy_SwarmConfig *DeepFuzzy_NewSwarmConfig(unsigned fcount, const char* file, unsigned line,
-						       enum DeepFuzzy_SwarmType stype) {
-  struct DeepFuzzy_SwarmConfig *new_config = malloc(sizeof(struct DeepFuzzy_SwarmConfig));
-  size_t buf_len = strlen(file) + 1;
-  new_config->file = malloc(buf_len);
-  strncpy(new_config->file, file, buf_len);
-  new_config->line = line;
+static void DeepFuzzy_NewSwarmConfig(struct DeepFuzzy_SwarmConfig *new_config,
+                                     unsigned fcount, unsigned site,
+                                     enum DeepFuzzy_SwarmType stype) {
+  new_config->file = DeepFuzzy_CallSites[site].file;
+  new_config->line = DeepFuzzy_CallSites[site].line;
   new_config->orig_fcount = fcount;
   new_config->fcount = 0;
+  new_config->site = site;
   if (stype == DeepFuzzy_SwarmTypeProb) {
-    new_config->fmap = malloc(sizeof(unsigned) * fcount * DEEPFUZZY_SWARM_MAX_PROB_RATIO);
+    new_config->fmap = DeepFuzzy_AllocSwarmFmap((size_t) fcount * DEEPFUZZY_SWARM_MAX_PROB_RATIO);
     for (int i = 0; i < fcount; i++) {
       unsigned int prob = DeepFuzzy_UIntInRange(0U, DEEPFUZZY_SWARM_MAX_PROB_RATIO);
       for (int j = 0; j < prob; j++) {
@@ -424,7 +716,7 @@ struct DeepFuzzy_SwarmConfig *DeepFuzzy_NewSwarmConfig(unsigned fcount, const ch
       new_config->fmap[new_config->fcount++] = DeepFuzzy_UIntInRange(0, fcount-1);
     }
   } else {
-    new_config->fmap = malloc(sizeof(unsigned) * fcount);
+    new_config->fmap = DeepFuzzy_AllocSwarmFmap(fcount);
     /* In mix mode, "half" the time just use everything */
     int full_config = (stype == DeepFuzzy_SwarmTypeMixed) && DeepFuzzy_Bool();
     if ((stype == DeepFuzzy_SwarmTypeMixed) && DeepFuzzy_UsingSymExec) {
@@ -450,24 +742,39 @@ struct DeepFuzzy_SwarmConfig *DeepFuzzy_NewSwarmConfig(unsigned fcount, const ch
   if (new_config->fcount == 0) {
     new_config->fmap[new_config->fcount++] = DeepFuzzy_UIntInRange(0, fcount-1);
   }
-  return new_config;
 }
 
 /* Either fetch existing configuration, or generate a new one. */
-struct DeepFuzzy_SwarmConfig *DeepFuzzy_GetSwarmConfig(unsigned fcount, const char* file, unsigned line,
-						       enum DeepFuzzy_SwarmType stype) {
-  /* In general, there should be few enough OneOfs in a harness that linear search is fine. */
-  for (int i = 0; i < DeepFuzzy_SwarmConfigsIndex; i++) {
-    struct DeepFuzzy_SwarmConfig* sc = DeepFuzzy_SwarmConfigs[i];
-    if ((sc->line == line) && (sc->orig_fcount == fcount) && (strncmp(sc->file, file, strlen(file)) == 0)) {
-      return sc;
+struct DeepFuzzy_SwarmConfig *DeepFuzzy_GetSwarmConfigAt(unsigned site, unsigned fcount,
+							 enum DeepFuzzy_SwarmType stype) {
+  /* Walk the configurations of this call site, newest first. */
+  unsigned last = DeepFuzzy_CallSiteSwarmConfig[site];
+  if (last < DeepFuzzy_SwarmConfigsIndex && DeepFuzzy_SwarmConfigs[last].site == site) {
+    for (unsigned i = last; i != DEEPFUZZY_MAX_SWARM_CONFIGS;
+         i = DeepFuzzy_SwarmConfigs[i].prev) {
+      if (DeepFuzzy_SwarmConfigs[i].orig_fcount == fcount) {
+        return &(DeepFuzzy_SwarmConfigs[i]);
+      }
     }
+  } else {
+    last = DEEPFUZZY_MAX_SWARM_CONFIGS;
   }
+
   if (DeepFuzzy_SwarmConfigsIndex == DEEPFUZZY_MAX_SWARM_CONFIGS) {
     DeepFuzzy_Abandon("Exceeded swarm config limit. Set or expand DEEPFUZZY_MAX_SWARM_CONFIGS. This is highly unusual.");
   }
-  DeepFuzzy_SwarmConfigs[DeepFuzzy_SwarmConfigsIndex] = DeepFuzzy_NewSwarmConfig(fcount, file, line, stype);
-  return DeepFuzzy_SwarmConfigs[DeepFuzzy_SwarmConfigsIndex++];
+  const unsigned index = DeepFuzzy_SwarmConfigsIndex;
+  struct DeepFuzzy_SwarmConfig *sc = &(DeepFuzzy_SwarmConfigs[index]);
+  DeepFuzzy_NewSwarmConfig(sc, fcount, site, stype);
+  sc->prev = last;
+  DeepFuzzy_CallSiteSwarmConfig[site] = index;
+  DeepFuzzy_SwarmConfigsIndex = index + 1;
+  return sc;
+}
+
+struct DeepFuzzy_SwarmConfig *DeepFuzzy_GetSwarmConfig(unsigned fcount, const char* file, unsigned line,
+						       enum DeepFuzzy_SwarmType stype) {
+  return DeepFuzzy_GetSwarmConfigAt(DeepFuzzy_RegisterCallSite(file, line), fcount, stype);
 }
 
 DEEPFUZZY_NOINLINE int DeepFuzzy_One(void) {
@@ -495,15 +802,91 @@ int DeepFuzzy_IsTrue(int expr) {
   }
 }
 
+/* Read `num_bits` bits of the input for the code at `site`, which identifies
+ * it in the `--trace_reads` trace. */
+static uint64_t DeepFuzzy_ReadBitsAt(unsigned num_bits, uint64_t site) {
+  const unsigned total_bits = num_bits;
+  const uint32_t offset =
+      (DeepFuzzy_BitCursorBitsLeft &&
+       DeepFuzzy_BitCursorIndex == DeepFuzzy_InputIndex) ?
+      DeepFuzzy_BitCursorIndex - 1 : DeepFuzzy_InputIndex;
+  uint64_t val = 0;
+  while (num_bits) {
+    /* Any whole-byte read since the last bit read moved the input index, and
+     * bits continue from a fresh byte. */
+    if (!DeepFuzzy_BitCursorBitsLeft ||
+        DeepFuzzy_BitCursorIndex != DeepFuzzy_InputIndex) {
+      if (DeepFuzzy_InputIndex >= DeepFuzzy_InputSize) {
+        DeepFuzzy_Abandon("Exceeded set input limit. Set or expand --max_input_size to write more bytes.");
+      }
+      if (DeepFuzzy_FastReads) {
+        DeepFuzzy_BitCursorByte = DeepFuzzy_ConsumeInput(1)[0];
+      } else {
+        if (FLAGS_verbose_reads) {
+          printf("Reading byte as bits at %u\n", DeepFuzzy_InputIndex);
+        }
+        DeepFuzzy_BitCursorByte = DEEPFUZZY_READBYTE;
+      }
+      DeepFuzzy_BitCursorIndex = DeepFuzzy_InputIndex;
+      DeepFuzzy_BitCursorBitsLeft = 8;
+    }
+    const unsigned take = num_bits < DeepFuzzy_BitCursorBitsLeft ?
+                          num_bits : DeepFuzzy_BitCursorBitsLeft;
+    DeepFuzzy_BitCursorBitsLeft -= take;
+    num_bits -= take;
+    val = (val << take) |
+          ((DeepFuzzy_BitCursorByte >> DeepFuzzy_BitCursorBitsLeft) &
+           ((1U << take) - 1U));
+  }
+  if (DeepFuzzy_TraceReads) {
+    DeepFuzzy_TraceBitsRead(offset, DeepFuzzy_InputIndex - offset, total_bits,
+                            val, site);
+  }
+  return val;
+}
+
+uint64_t DeepFuzzy_ReadBits(unsigned num_bits) {
+  return DeepFuzzy_ReadBitsAt(
+      num_bits, (uint64_t) (uintptr_t) DEEPFUZZY_RETURN_ADDRESS());
+}
+
+uint64_t DeepFuzzy_CompactRange(uint64_t span) {
+  if (!span) {
+    return 0;
+  }
+  const unsigned num_bits = 64 - (unsigned) __builtin_clzll(span);
+  const uint64_t val = DeepFuzzy_ReadBitsAt(
+      num_bits, (uint64_t) (uintptr_t) DEEPFUZZY_RETURN_ADDRESS());
+  if (FLAGS_verbose_reads) {
+    printf("Read %u bits for range of size %" PRIu64 "\n", num_bits, span);
+  }
+
+  /* Values past the range wrap around, like out-of-range values of the
+   * whole-byte encoding do. */
+  return val <= span ? val : val % (span + 1);
+}
+
 /* Return a symbolic value of a given type. */
 int DeepFuzzy_Bool(void) {
+  if (DeepFuzzy_CompactEncoding) {
+    return (int) DeepFuzzy_ReadBitsAt(
+        1, (uint64_t) (uintptr_t) DEEPFUZZY_RETURN_ADDRESS());
+  }
   if (DeepFuzzy_InputIndex >= DeepFuzzy_InputSize) {
-    DeepFuzzy_Abandon("Exceeded set input limit. Set or expand DEEPFUZZY_SIZE to write more bytes.");
+    DeepFuzzy_Abandon("Exceeded set input limit. Set or expand --max_input_size to write more bytes.");
+  }
+  if (DeepFuzzy_FastReads) {
+    return DeepFuzzy_ConsumeInput(1)[0] & 1;
   }
   if (FLAGS_verbose_reads) {
     printf("Reading byte as boolean at %u\n", DeepFuzzy_InputIndex);
   }
-  return DEEPFUZZY_READBYTE & 1;
+  const int val = DEEPFUZZY_READBYTE & 1;
+  if (DeepFuzzy_TraceReads) {
+    DeepFuzzy_TraceRead(DeepFuzzy_TraceBool, DeepFuzzy_InputIndex - 1, 1, val,
+                        (uint64_t) (uintptr_t) DEEPFUZZY_RETURN_ADDRESS());
+  }
+  return val;
 }
 
 
@@ -511,7 +894,11 @@ int DeepFuzzy_Bool(void) {
 #define MAKE_SYMBOL_FUNC(Type, type) \
     type DeepFuzzy_ ## Type(void) { \
       if ((DeepFuzzy_InputIndex + sizeof(type)) > DeepFuzzy_InputSize) { \
-        DeepFuzzy_Abandon("Exceeded set input limit. Set or expand DEEPFUZZY_SIZE to write more bytes."); \
+        DeepFuzzy_Abandon("Exceeded set input limit. Set or expand --max_input_size to write more bytes."); \
+      } \
+      if (DeepFuzzy_FastReads) { \
+        return (type) DeepFuzzy_LoadBigEndian( \
+            DeepFuzzy_ConsumeInput(sizeof(type)), sizeof(type)); \
       } \
       type val = 0; \
       if (FLAGS_verbose_reads) { \
@@ -527,6 +914,12 @@ int DeepFuzzy_Bool(void) {
       if (FLAGS_verbose_reads) { \
         printf("FINISHED MULTI-BYTE READ\n"); \
       } \
+      if (DeepFuzzy_TraceReads) { \
+        DeepFuzzy_TraceRead(DeepFuzzy_TraceInt, \
+                            DeepFuzzy_InputIndex - sizeof(type), \
+                            sizeof(type), (int64_t) val, \
+                            (uint64_t) (uintptr_t) DEEPFUZZY_RETURN_ADDRESS()); \
+      } \
       return val; \
     }
 
@@ -644,13 +1037,80 @@ extern void DeepFuzzy_CleanUp() {
     free(DeepFuzzy_GeneratedAllocs[i]);
   }
   DeepFuzzy_GeneratedAllocsIndex = 0;
-  
-  for (int i = 0; i < DeepFuzzy_SwarmConfigsIndex; i++) {
-    free(DeepFuzzy_SwarmConfigs[i]->file);
-    free(DeepFuzzy_SwarmConfigs[i]->fmap);
-    free(DeepFuzzy_SwarmConfigs[i]);
+  DeepFuzzy_SwarmConfigsIndex = 0;
+}
+
+void DeepFuzzy_RegisterReset(DeepFuzzy_ResetFunc fn) {
+  if (DeepFuzzy_NumResetFuncs == DEEPFUZZY_MAX_RESET_FUNCS) {
+    DeepFuzzy_Log(DeepFuzzy_LogError,
+                  "Exceeded reset function limit. Set or expand DEEPFUZZY_MAX_RESET_FUNCS.");
+    exit(1);
+  }
+  DeepFuzzy_ResetFuncs[DeepFuzzy_NumResetFuncs++] = fn;
+}
+
+void DeepFuzzy_ResetState(void) {
+  DeepFuzzy_CleanUp();
+  DeepFuzzy_ResetStreams();
+
+  if (DeepFuzzy_CurrentTestRun) {
+    DeepFuzzy_CurrentTestRun->result = DeepFuzzy_TestRunPass;
+    DeepFuzzy_CurrentTestRun->reason = NULL;
+    DeepFuzzy_CurrentTestRun->fail_location[0] = '\0';
+  }
+
+  for (unsigned i = 0; i < DeepFuzzy_NumResetFuncs; i++) {
+    DeepFuzzy_ResetFuncs[i]();
+  }
+}
+
+static const char *DeepFuzzy_TestRunResultName(enum DeepFuzzy_TestRunResult result) {
+  switch (result) {
+    case DeepFuzzy_TestRunPass: return "passed";
+    case DeepFuzzy_TestRunFail: return "failed";
+    case DeepFuzzy_TestRunCrash: return "crashed";
+    case DeepFuzzy_TestRunAbandon: return "was abandoned";
+    case DeepFuzzy_TestRunHang: return "timed out";
+    case DeepFuzzy_TestRunOOM: return "ran out of memory";
+    default: return "ended";
+  }
+}
+
+enum DeepFuzzy_TestRunResult
+DeepFuzzy_RunTestInProcess(struct DeepFuzzy_TestInfo *test) {
+  enum DeepFuzzy_TestRunResult result =
+      (enum DeepFuzzy_TestRunResult) DeepFuzzy_RunTestNoFork(test);
+  DeepFuzzy_ResetState();
+  if (!FLAGS_check_reset) {
+    return result;
   }
+
+  /* Run the test again on the bytes it read the first time; if nothing leaked
+   * from the first run, the second one behaves the same. */
+  uint32_t input_index = DeepFuzzy_InputIndex;
+  DeepFuzzy_InputIndex = 0;
   DeepFuzzy_SwarmConfigsIndex = 0;
+  DeepFuzzy_InitCurrentTestRun(test);
+
+  DeepFuzzy_SuppressSaves = 1;
+  enum DeepFuzzy_TestRunResult check_result =
+      (enum DeepFuzzy_TestRunResult) DeepFuzzy_RunTestNoFork(test);
+  DeepFuzzy_SuppressSaves = 0;
+  uint32_t check_input_index = DeepFuzzy_InputIndex;
+  DeepFuzzy_ResetState();
+  DeepFuzzy_InputIndex = input_index;
+
+  if (check_result != result || check_input_index != input_index) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError,
+                        "Reset check failed: %s %s after reading %u bytes, but %s "
+                        "after reading %u bytes when run again; state is leaking "
+                        "between in-process runs",
+                        test->test_name, DeepFuzzy_TestRunResultName(result),
+                        input_index, DeepFuzzy_TestRunResultName(check_result),
+                        check_input_index);
+    return DeepFuzzy_TestRunFail;
+  }
+  return result;
 }
 
 void _DeepFuzzy_Assume(int expr, const char *expr_str, const char *file,
@@ -702,8 +1162,8 @@ const struct DeepFuzzy_IndexEntry DeepFuzzy_API[] = {
   {"LastTestInfo",    (void *) &DeepFuzzy_LastTestInfo},
 
   /* Source of symbolic bytes. */
-  {"InputBegin",      (void *) &(DeepFuzzy_Input[0])},
-  {"InputEnd",        (void *) &(DeepFuzzy_Input[DeepFuzzy_InputSize])},
+  {"InputBegin",      (void *) &(DeepFuzzy_StaticInput[0])},
+  {"InputEnd",        (void *) &(DeepFuzzy_StaticInput[DEEPFUZZY_SIZE])},
   {"InputIndex",      (void *) &DeepFuzzy_InputIndex},
 
   /* Solver APIs. */
@@ -730,6 +1190,30 @@ const struct DeepFuzzy_IndexEntry DeepFuzzy_API[] = {
   {NULL, NULL},
 };
 
+void DeepFuzzy_InitInputBuffer(void) {
+  static int initialized = 0;
+  DeepFuzzy_SelectReadPath();
+  if (initialized || DeepFuzzy_UsingSymExec) {
+    return;
+  }
+  initialized = 1;
+
+  if (!FLAGS_max_input_size) {
+    DeepFuzzy_Log(DeepFuzzy_LogError, "The maximum input size must be positive");
+    exit(1);
+  }
+  volatile uint8_t *input =
+      (volatile uint8_t *) DeepFuzzy_AllocGuardedMemory(FLAGS_max_input_size);
+  if (input == NULL) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError,
+                        "Unable to allocate an input buffer of %u bytes",
+                        FLAGS_max_input_size);
+    exit(1);
+  }
+  DeepFuzzy_Input = input;
+  DeepFuzzy_InputSize = FLAGS_max_input_size;
+}
+
 /* Set up DeepFuzzy. */
 DEEPFUZZY_NOINLINE
 void DeepFuzzy_Setup(void) {
@@ -776,63 +1260,398 @@ void DeepFuzzy_Warn_srand(unsigned int seed) {
               "srand under DeepFuzzy has no effect: rand is re-defined as DeepFuzzy_Int");
 }
 
-/* Right now "fake" a hexdigest by just using random bytes.  Not ideal. */
-void makeFilename(char *name, size_t size) {
-  const char *entities = "0123456789abcdef";
-  for (int i = 0; i < size; i++) {
-    name[i] = entities[rand()%16];
+static DEEPFUZZY_INLINE uint64_t DeepFuzzy_RotL64(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+#define DEEPFUZZY_XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define DEEPFUZZY_XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define DEEPFUZZY_XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define DEEPFUZZY_XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define DEEPFUZZY_XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+/* Read little-endian integers, so that hashes don't depend on the host. */
+static DEEPFUZZY_INLINE uint64_t DeepFuzzy_ReadLE64(const uint8_t *p) {
+  uint64_t x = 0;
+  for (int i = 7; i >= 0; i--) {
+    x = (x << 8) | p[i];
   }
+  return x;
 }
 
-void writeInputData(char* name, int important) {
+static DEEPFUZZY_INLINE uint64_t DeepFuzzy_ReadLE32(const uint8_t *p) {
+  return (uint64_t) p[0] | ((uint64_t) p[1] << 8) | ((uint64_t) p[2] << 16) |
+         ((uint64_t) p[3] << 24);
+}
+
+static DEEPFUZZY_INLINE uint64_t DeepFuzzy_XXH64Round(uint64_t acc, uint64_t input) {
+  acc += input * DEEPFUZZY_XXH_PRIME64_2;
+  return DeepFuzzy_RotL64(acc, 31) * DEEPFUZZY_XXH_PRIME64_1;
+}
+
+static DEEPFUZZY_INLINE uint64_t DeepFuzzy_XXH64Merge(uint64_t acc, uint64_t val) {
+  acc ^= DeepFuzzy_XXH64Round(0, val);
+  return acc * DEEPFUZZY_XXH_PRIME64_1 + DEEPFUZZY_XXH_PRIME64_4;
+}
+
+/* XXH64 hash of `len` bytes at `data`. */
+static uint64_t DeepFuzzy_XXH64(const uint8_t *data, size_t len, uint64_t seed) {
+  const uint8_t *end = data + len;
+  uint64_t h;
+
+  if (len >= 32) {
+    uint64_t v1 = seed + DEEPFUZZY_XXH_PRIME64_1 + DEEPFUZZY_XXH_PRIME64_2;
+    uint64_t v2 = seed + DEEPFUZZY_XXH_PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - DEEPFUZZY_XXH_PRIME64_1;
+    for (; data + 32 <= end; data += 32) {
+      v1 = DeepFuzzy_XXH64Round(v1, DeepFuzzy_ReadLE64(data));
+      v2 = DeepFuzzy_XXH64Round(v2, DeepFuzzy_ReadLE64(data + 8));
+      v3 = DeepFuzzy_XXH64Round(v3, DeepFuzzy_ReadLE64(data + 16));
+      v4 = DeepFuzzy_XXH64Round(v4, DeepFuzzy_ReadLE64(data + 24));
+    }
+    h = DeepFuzzy_RotL64(v1, 1) + DeepFuzzy_RotL64(v2, 7) +
+        DeepFuzzy_RotL64(v3, 12) + DeepFuzzy_RotL64(v4, 18);
+    h = DeepFuzzy_XXH64Merge(h, v1);
+    h = DeepFuzzy_XXH64Merge(h, v2);
+    h = DeepFuzzy_XXH64Merge(h, v3);
+    h = DeepFuzzy_XXH64Merge(h, v4);
+  } else {
+    h = seed + DEEPFUZZY_XXH_PRIME64_5;
+  }
+
+  h += (uint64_t) len;
+  for (; data + 8 <= end; data += 8) {
+    h ^= DeepFuzzy_XXH64Round(0, DeepFuzzy_ReadLE64(data));
+    h = DeepFuzzy_RotL64(h, 27) * DEEPFUZZY_XXH_PRIME64_1 + DEEPFUZZY_XXH_PRIME64_4;
+  }
+  if (data + 4 <= end) {
+    h ^= DeepFuzzy_ReadLE32(data) * DEEPFUZZY_XXH_PRIME64_1;
+    h = DeepFuzzy_RotL64(h, 23) * DEEPFUZZY_XXH_PRIME64_2 + DEEPFUZZY_XXH_PRIME64_3;
+    data += 4;
+  }
+  for (; data < end; data++) {
+    h ^= *data * DEEPFUZZY_XXH_PRIME64_5;
+    h = DeepFuzzy_RotL64(h, 11) * DEEPFUZZY_XXH_PRIME64_1;
+  }
+
+  h ^= h >> 33;
+  h *= DEEPFUZZY_XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= DEEPFUZZY_XXH_PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+/* Name a saved test after a 128-bit hash of the input it consumed, followed by
+ * `extension`, like the symbolic executors name tests after the MD5 of their
+ * input. `name` must hold at least `DEEPFUZZY_TEST_NAME_LEN + 1 +
+ * strlen(extension)` characters. */
+void makeFilename(char *name, size_t size, const char *extension) {
+  const uint8_t *data = (const uint8_t *) DeepFuzzy_Input;
+  uint64_t high = DeepFuzzy_XXH64(data, DeepFuzzy_InputIndex, 0);
+  uint64_t low = DeepFuzzy_XXH64(data, DeepFuzzy_InputIndex, high);
+  snprintf(name, size, "%016" PRIx64 "%016" PRIx64 "%s", high, low, extension);
+}
+
+int DeepFuzzy_WriteTestFile(const char *name, const uint8_t *data, size_t size,
+                            bool sync) {
   size_t path_len = 2 + sizeof(char) * (strlen(FLAGS_output_test_dir) + strlen(name));
   char *path = (char *) malloc(path_len);
   snprintf(path, path_len, "%s/%s", FLAGS_output_test_dir, name);
-  FILE *fp = fopen(path, "wb");
+
+  /* Tests are named after their input, so an existing file means that this
+   * input was saved before, e.g. by another worker. */
+  FILE *fp = fopen(path, "wbx");
+  free(path);
   if (fp == NULL) {
-    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Failed to create file `%s`", path);
+    return errno == EEXIST ? EEXIST : -1;
+  }
+  int ret = 0;
+  if (fwrite((const void *) data, 1, size, fp) != size) {
+    ret = -1;
+  } else if (sync && (fflush(fp) || DeepFuzzy_SyncFile(fp))) {
+    ret = -1;
+  }
+  if (fclose(fp)) {
+    ret = -1;
+  }
+  return ret;
+}
+
+/* Save the consumed input to `name` in the output test directory. Returns
+ * `false` if it was not saved, e.g. because a test with the same input was
+ * saved already. */
+bool writeInputData(const char *name, int important) {
+  if (DeepFuzzy_SuppressSaves) {
+    return false;
+  }
+  int ret = DeepFuzzy_WriteTestFile(name, (const uint8_t *) DeepFuzzy_Input,
+                                    DeepFuzzy_InputIndex, false);
+  if (ret == EEXIST) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogTrace, "Test case in file `%s/%s` was already saved",
+                        FLAGS_output_test_dir, name);
+  } else if (ret) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Failed to save test case in file `%s/%s`",
+                        FLAGS_output_test_dir, name);
+  } else if (important) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "Saved test case in file `%s/%s`",
+                        FLAGS_output_test_dir, name);
+  } else {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogTrace, "Saved test case in file `%s/%s`",
+                        FLAGS_output_test_dir, name);
+  }
+  return !ret;
+}
+
+/* Save a passing test to the output test directory, from the save writer
+ * thread if it is running. */
+void DeepFuzzy_SavePassingTest(void) {
+  if (DeepFuzzy_SuppressSaves) {
+    return;
+  }
+  char name[DEEPFUZZY_TEST_NAME_LEN + 8];
+  makeFilename(name, sizeof(name), ".pass");
+  if (!DeepFuzzy_QueueSave(name, (const uint8_t *) DeepFuzzy_Input, DeepFuzzy_InputIndex)) {
+    writeInputData(name, 0);
+  }
+}
+
+/* Describe the failure, crash or hang of the current test in `desc`, and
+ * return its signature: a hash of the description, which is never `0`. */
+static uint64_t DeepFuzzy_FailureSignature(enum DeepFuzzy_TestRunResult result,
+                                           char *desc, size_t size) {
+  const char *location = DeepFuzzy_CurrentTestRun->fail_location;
+  if (result == DeepFuzzy_TestRunHang) {
+    snprintf(desc, size, "timeout");
+  } else if (result == DeepFuzzy_TestRunOOM) {
+    snprintf(desc, size, "out of memory");
+  } else if (result != DeepFuzzy_TestRunCrash) {
+    snprintf(desc, size, "%s", location[0] ? location : "unknown location");
+  } else if (location[0]) {
+    snprintf(desc, size, "signal %d at 0x%" PRIxPTR " after %s",
+             DeepFuzzy_CurrentTestRun->crash_signal,
+             DeepFuzzy_CurrentTestRun->crash_pc, location);
+  } else {
+    snprintf(desc, size, "signal %d at 0x%" PRIxPTR,
+             DeepFuzzy_CurrentTestRun->crash_signal,
+             DeepFuzzy_CurrentTestRun->crash_pc);
+  }
+
+  /* FNV-1a. */
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const char *c = desc; *c; c++) {
+    hash = (hash ^ (uint8_t) *c) * 0x100000001b3ULL;
+  }
+  return hash ? hash : 1;
+}
+
+/* Find or add the save bucket of the failure or crash of the current test.
+ * Returns `NULL` if deduplication is off or the table is full. */
+static struct DeepFuzzy_SaveBucket *
+DeepFuzzy_FindSaveBucket(enum DeepFuzzy_TestRunResult result) {
+  if (DeepFuzzy_SaveBuckets == NULL) {
+    return NULL;
+  }
+  char desc[sizeof(DeepFuzzy_SaveBuckets[0].description)];
+  uint64_t signature = DeepFuzzy_FailureSignature(result, desc, sizeof(desc));
+
+  /* Linear probing; buckets are only ever added, by claiming an empty slot. */
+  for (unsigned i = 0; i < DEEPFUZZY_MAX_SAVE_BUCKETS; i++) {
+    struct DeepFuzzy_SaveBucket *bucket =
+        &(DeepFuzzy_SaveBuckets[(signature + i) % DEEPFUZZY_MAX_SAVE_BUCKETS]);
+    uint64_t found = __atomic_load_n(&bucket->signature, __ATOMIC_ACQUIRE);
+    if (!found) {
+      uint64_t empty = 0;
+      if (__atomic_compare_exchange_n(&bucket->signature, &empty, signature, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        memcpy(bucket->description, desc, sizeof(desc));
+        return bucket;
+      }
+      found = empty;
+    }
+    if (found == signature) {
+      return bucket;
+    }
+  }
+
+  static int warned = 0;
+  if (!warned) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogWarning,
+                        "Too many distinct failures to deduplicate saved tests; "
+                        "set or expand DEEPFUZZY_MAX_SAVE_BUCKETS");
+    warned = 1;
+  }
+  return NULL;
+}
+
+/* Name the reproducer of `bucket` that is `size` bytes long. */
+static void DeepFuzzy_SmallestTestPath(char *path, size_t path_len,
+                                       struct DeepFuzzy_SaveBucket *bucket,
+                                       uint32_t size, const char *extension) {
+  snprintf(path, path_len, "%s/%016" PRIx64 "-%" PRIu32 "%s", FLAGS_output_test_dir,
+           bucket->signature, size, extension);
+}
+
+/* Save the input of the current test as the single reproducer of `bucket`,
+ * named after its signature and size, unless a smaller one was saved already.
+ *
+ * `bucket->smallest` is one more than the size of the smallest test claimed so
+ * far, or `0` if none was. Each size is claimed at most once, so workers never
+ * publish to the same file, and a worker that is outdone by a smaller test
+ * removes its own file, or has it removed by the worker that outdid it. */
+static void DeepFuzzy_SaveSmallestTest(struct DeepFuzzy_SaveBucket *bucket,
+                                       const char *extension) {
+  uint32_t size = DeepFuzzy_InputIndex;
+  uint32_t claim = size + 1;
+  uint32_t smallest = __atomic_load_n(&bucket->smallest, __ATOMIC_RELAXED);
+  if (smallest && smallest <= claim) {
+    return;
+  }
+
+  size_t path_len = strlen(FLAGS_output_test_dir) + DEEPFUZZY_TEST_NAME_LEN +
+                    strlen(extension) + 16;
+  char *tmp_path = (char *) malloc(path_len);
+  char *path = (char *) malloc(path_len);
+  if (tmp_path == NULL || path == NULL) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Failed to allocate the path of a saved test");
+    free(tmp_path);
+    free(path);
+    return;
+  }
+
+  /* Write to a temporary file first, so that the bucket only records tests
+   * that were written, and a saved test never appears half written. */
+  char tmp_name[DEEPFUZZY_TEST_NAME_LEN + 8];
+  makeFilename(tmp_name, sizeof(tmp_name), ".tmp");
+  snprintf(tmp_path, path_len, "%s/%s", FLAGS_output_test_dir, tmp_name);
+  DeepFuzzy_SmallestTestPath(path, path_len, bucket, size, extension);
+  if (!writeInputData(tmp_name, 0)) {
+    free(tmp_path);
     free(path);
     return;
   }
-  size_t written = fwrite((void *)DeepFuzzy_Input, 1, DeepFuzzy_InputIndex, fp);
-  if (written != DeepFuzzy_InputIndex) {
-    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Failed to write to file `%s`", path);
+
+  int claimed = 0;
+  do {
+    if (smallest && smallest <= claim) {
+      break;
+    }
+    claimed = __atomic_compare_exchange_n(&bucket->smallest, &smallest, claim, false,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+  } while (!claimed);
+
+  if (!claimed) {
+    remove(tmp_path);
+  } else if (rename(tmp_path, path)) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Failed to rename `%s` to `%s`", tmp_path, path);
+    remove(tmp_path);
   } else {
-    if (important) {
-      DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "Saved test case in file `%s`", path);
-    } else {
-      DeepFuzzy_LogFormat(DeepFuzzy_LogTrace, "Saved test case in file `%s`", path);
+    __atomic_fetch_add(&bucket->saves, 1, __ATOMIC_RELAXED);
+    DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "Saved test case in file `%s`", path);
+
+    /* Remove the test this one replaced. If its worker hasn't published it
+     * yet, that worker removes it below. */
+    if (smallest) {
+      DeepFuzzy_SmallestTestPath(tmp_path, path_len, bucket, smallest - 1, extension);
+      remove(tmp_path);
+    }
+
+    /* A smaller test was claimed since, and may have missed this one. */
+    if (__atomic_load_n(&bucket->smallest, __ATOMIC_RELAXED) != claim) {
+      remove(path);
     }
   }
+  free(tmp_path);
   free(path);
-  fclose(fp);
 }
 
-/* Save a passing test to the output test directory. */
-void DeepFuzzy_SavePassingTest(void) {
-  char name[48];
-  makeFilename(name, 40);
-  name[40] = 0;
-  strncat(name, ".pass", 48);
-  writeInputData(name, 0);
+/* Save a failing, crashing, hanging or out of memory test to the output test
+ * directory, unless enough tests with the same failure location or crash
+ * site were saved already. */
+static void DeepFuzzy_SaveImportantTest(enum DeepFuzzy_TestRunResult result,
+                                        const char *extension) {
+  if (DeepFuzzy_SuppressSaves) {
+    return;
+  }
+
+  struct DeepFuzzy_SaveBucket *bucket = DeepFuzzy_FindSaveBucket(result);
+  if (bucket != NULL) {
+    __atomic_fetch_add(&bucket->hits, 1, __ATOMIC_RELAXED);
+    if (FLAGS_save_smallest_per_bucket) {
+      DeepFuzzy_SaveSmallestTest(bucket, extension);
+      return;
+    }
+    uint32_t saves = __atomic_load_n(&bucket->saves, __ATOMIC_RELAXED);
+    do {
+      if (saves >= FLAGS_max_saves_per_bucket) {
+        return;
+      }
+    } while (!__atomic_compare_exchange_n(&bucket->saves, &saves, saves + 1, false,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  }
+
+  char name[DEEPFUZZY_TEST_NAME_LEN + 8];
+  makeFilename(name, sizeof(name), extension);
+  writeInputData(name, 1);
 }
 
 /* Save a failing test to the output test directory. */
 void DeepFuzzy_SaveFailingTest(void) {
-  char name[48];
-  makeFilename(name, 40);
-  name[40] = 0;
-  strncat(name, ".fail", 48);
-  writeInputData(name, 1);
+  DeepFuzzy_SaveImportantTest(DeepFuzzy_TestRunFail, ".fail");
 }
 
 /* Save a crashing test to the output test directory. */
 void DeepFuzzy_SaveCrashingTest(void) {
-  char name[48];
-  makeFilename(name, 40);
-  name[40] = 0;
-  strncat(name, ".crash", 48);
-  writeInputData(name, 1);
+  DeepFuzzy_SaveImportantTest(DeepFuzzy_TestRunCrash, ".crash");
+}
+
+/* Save a hanging test to the output test directory. */
+void DeepFuzzy_SaveHangingTest(void) {
+  DeepFuzzy_SaveImportantTest(DeepFuzzy_TestRunHang, ".hang");
+}
+
+/* Save a test that ran out of memory to the output test directory. */
+void DeepFuzzy_SaveOutOfMemoryTest(void) {
+  DeepFuzzy_SaveImportantTest(DeepFuzzy_TestRunOOM, ".oom");
+}
+
+/* Set up deduplication of saved failing and crashing tests, if enabled. */
+static void DeepFuzzy_InitSaveBuckets(void) {
+  if (!FLAGS_max_saves_per_bucket && !FLAGS_save_smallest_per_bucket) {
+    return;
+  }
+  DeepFuzzy_SaveBuckets = (struct DeepFuzzy_SaveBucket *) DeepFuzzy_AllocSharedMemory(
+      DEEPFUZZY_MAX_SAVE_BUCKETS * sizeof(struct DeepFuzzy_SaveBucket));
+}
+
+/* Log how often each distinct failure or crash was hit, and how many tests
+ * were saved for it. */
+static void DeepFuzzy_LogSaveBuckets(void) {
+  if (DeepFuzzy_SaveBuckets == NULL) {
+    return;
+  }
+  unsigned num_buckets = 0;
+  for (unsigned i = 0; i < DEEPFUZZY_MAX_SAVE_BUCKETS; i++) {
+    num_buckets += DeepFuzzy_SaveBuckets[i].signature != 0;
+  }
+  DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "Found %u distinct failures", num_buckets);
+
+  for (unsigned i = 0; i < DEEPFUZZY_MAX_SAVE_BUCKETS; i++) {
+    struct DeepFuzzy_SaveBucket *bucket = &(DeepFuzzy_SaveBuckets[i]);
+    if (!bucket->signature) {
+      continue;
+    }
+    if (FLAGS_save_smallest_per_bucket && bucket->smallest) {
+      DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "  %016" PRIx64 " %s: %u hits, smallest test %u bytes",
+                          bucket->signature, bucket->description, bucket->hits,
+                          bucket->smallest - 1);
+    } else {
+      DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "  %016" PRIx64 " %s: %u hits, %u saved",
+                          bucket->signature, bucket->description, bucket->hits,
+                          bucket->saves);
+    }
+  }
 }
 
 /* Return the first test case to run. */
@@ -850,6 +1669,374 @@ bool DeepFuzzy_CatchAbandoned(void) {
   return DeepFuzzy_CurrentTestRun->result == DeepFuzzy_TestRunAbandon;
 }
 
+static uint64_t DeepFuzzy_SplitMix64(uint64_t *x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* Return the next output of the xoshiro256** generator with state `s`. */
+static DEEPFUZZY_INLINE uint64_t DeepFuzzy_Xoshiro256(uint64_t *s) {
+  const uint64_t result = DeepFuzzy_RotL64(s[1] * 5, 7) * 9;
+  const uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = DeepFuzzy_RotL64(s[3], 45);
+  return result;
+}
+
+/* Advance the xoshiro256** generator with state `s` by 2^128 outputs, which
+ * gives each fuzzer worker a non-overlapping stream. */
+static void DeepFuzzy_Xoshiro256Jump(uint64_t *s) {
+  static const uint64_t jump[] = {
+    0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+  };
+  uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  for (int i = 0; i < 4; i++) {
+    for (int b = 0; b < 64; b++) {
+      if (jump[i] & (1ULL << b)) {
+        s0 ^= s[0];
+        s1 ^= s[1];
+        s2 ^= s[2];
+        s3 ^= s[3];
+      }
+      (void) DeepFuzzy_Xoshiro256(s);
+    }
+  }
+  s[0] = s0;
+  s[1] = s1;
+  s[2] = s2;
+  s[3] = s3;
+}
+
+/* Seed the built-in fuzzer for fuzzer worker number `worker`. */
+static void DeepFuzzy_SeedFuzzer(uint64_t seed, unsigned worker) {
+  for (int i = 0; i < 4; i++) {
+    DeepFuzzy_FuzzSeedState[i] = DeepFuzzy_SplitMix64(&seed);
+  }
+  for (unsigned i = 0; i < worker; i++) {
+    DeepFuzzy_Xoshiro256Jump(DeepFuzzy_FuzzSeedState);
+  }
+}
+
+/* Seed the input generator for the next fuzzed test. */
+static void DeepFuzzy_SeedFuzzInput(void) {
+  uint64_t seed = DeepFuzzy_Xoshiro256(DeepFuzzy_FuzzSeedState);
+  for (int i = 0; i < 4; i++) {
+    DeepFuzzy_FuzzInputState[i] = DeepFuzzy_SplitMix64(&seed);
+  }
+}
+
+uint64_t DeepFuzzy_FuzzRandom(void) {
+  return DeepFuzzy_Xoshiro256(DeepFuzzy_FuzzInputState);
+}
+
+void DeepFuzzy_GetFuzzInputState(uint64_t state[4]) {
+  memcpy(state, DeepFuzzy_FuzzInputState, sizeof(DeepFuzzy_FuzzInputState));
+}
+
+void DeepFuzzy_SetFuzzInputState(const uint64_t state[4]) {
+  memcpy(DeepFuzzy_FuzzInputState, state, sizeof(DeepFuzzy_FuzzInputState));
+}
+
+/* Set when `--coverage` is used and the harness is instrumented. */
+static bool DeepFuzzy_CoverageGuided = false;
+
+uint8_t DeepFuzzy_FuzzFillBlock(void) {
+  uint32_t end = (DeepFuzzy_InputIndex + DEEPFUZZY_FUZZ_BLOCK_SIZE) &
+                 ~(uint32_t) (DEEPFUZZY_FUZZ_BLOCK_SIZE - 1);
+  if (end > DeepFuzzy_InputSize) {
+    end = DeepFuzzy_InputSize;
+  }
+
+  /* Bytes are taken least significant first, so that the same seed produces
+   * the same input regardless of the host's byte order. */
+  uint8_t *input = (uint8_t *) DeepFuzzy_Input;
+  uint32_t i = DeepFuzzy_InputInitialized;
+  while (i < end) {
+    uint64_t rand_v = DeepFuzzy_Xoshiro256(DeepFuzzy_FuzzInputState);
+    for (int j = 0; j < 8 && i < end; j++, i++, rand_v >>= 8) {
+      input[i] = (uint8_t) rand_v;
+    }
+  }
+  DeepFuzzy_InputInitialized = end;
+
+  return DeepFuzzy_Input[DeepFuzzy_InputIndex];
+}
+
+/* Return the histogram bucket of an execution time of `ns` nanoseconds. */
+static unsigned DeepFuzzy_LatencyBucket(uint64_t ns) {
+  if (ns < 2 * DEEPFUZZY_LATENCY_SUB_BUCKETS) {
+    return (unsigned) ns;
+  }
+  unsigned log2 = 0;
+  for (unsigned step = 32; step; step >>= 1) {
+    if (ns >> (log2 + step)) {
+      log2 += step;
+    }
+  }
+  if (log2 >= DEEPFUZZY_LATENCY_MAX_LOG2) {
+    return DEEPFUZZY_LATENCY_BUCKETS - 1;
+  }
+  unsigned shift = log2 - DEEPFUZZY_LATENCY_SUB_BUCKET_BITS;
+  return shift * DEEPFUZZY_LATENCY_SUB_BUCKETS + (unsigned) (ns >> shift);
+}
+
+/* Return the smallest execution time in nanoseconds that falls into
+ * `bucket`. */
+static uint64_t DeepFuzzy_LatencyBucketStart(unsigned bucket) {
+  if (bucket < 2 * DEEPFUZZY_LATENCY_SUB_BUCKETS) {
+    return bucket;
+  }
+  unsigned shift = bucket / DEEPFUZZY_LATENCY_SUB_BUCKETS - 1;
+  uint64_t mantissa = DEEPFUZZY_LATENCY_SUB_BUCKETS +
+                      bucket % DEEPFUZZY_LATENCY_SUB_BUCKETS;
+  return mantissa << shift;
+}
+
+/* Format `ns` nanoseconds into `buf` in a human-readable unit. */
+static void DeepFuzzy_FormatNanos(char *buf, size_t size, uint64_t ns) {
+  if (ns < 1000) {
+    snprintf(buf, size, "%uns", (unsigned) ns);
+  } else if (ns < 1000000) {
+    snprintf(buf, size, "%.1fus", ns / 1e3);
+  } else if (ns < 1000000000) {
+    snprintf(buf, size, "%.1fms", ns / 1e6);
+  } else {
+    snprintf(buf, size, "%.1fs", ns / 1e9);
+  }
+}
+
+struct DeepFuzzy_TestUsage DeepFuzzy_LastTestUsage = {0};
+
+void DeepFuzzy_AddTestUsage(struct DeepFuzzy_TestUsage *total,
+                            const struct DeepFuzzy_TestUsage *usage) {
+  total->num_tests += usage->num_tests;
+  if (usage->max_rss_kb > total->max_rss_kb) {
+    total->max_rss_kb = usage->max_rss_kb;
+  }
+  total->user_us += usage->user_us;
+  total->sys_us += usage->sys_us;
+  total->minor_faults += usage->minor_faults;
+  total->major_faults += usage->major_faults;
+  total->voluntary_switches += usage->voluntary_switches;
+  total->involuntary_switches += usage->involuntary_switches;
+}
+
+void DeepFuzzy_LogTestUsage(enum DeepFuzzy_LogLevel level,
+                            const struct DeepFuzzy_TestUsage *usage) {
+  if (!usage->num_tests) {
+    return;
+  }
+  double n = (double) usage->num_tests;
+  char user[32], sys[32];
+  DeepFuzzy_FormatNanos(user, sizeof(user), (uint64_t) (usage->user_us * 1000 / n));
+  DeepFuzzy_FormatNanos(sys, sizeof(sys), (uint64_t) (usage->sys_us * 1000 / n));
+  DeepFuzzy_LogFormat(level, "Test resources: peak RSS %.1f MB; per test: %s user and %s system CPU, "
+                      "%.1f minor and %.1f major page faults, %.1f voluntary and %.1f involuntary context switches",
+                      usage->max_rss_kb / 1024.0, user, sys,
+                      usage->minor_faults / n, usage->major_faults / n,
+                      usage->voluntary_switches / n, usage->involuntary_switches / n);
+}
+
+/* Return an upper bound on the execution time of `fraction` of the tests
+ * counted in `counts`, but no more than `max_ns`. */
+static uint64_t DeepFuzzy_LatencyPercentile(const uint64_t *counts,
+                                            uint64_t total, double fraction,
+                                            uint64_t max_ns) {
+  uint64_t target = (uint64_t) (total * fraction);
+  uint64_t seen = 0;
+  unsigned bucket = 0;
+  for (; bucket < DEEPFUZZY_LATENCY_BUCKETS - 1; bucket++) {
+    seen += counts[bucket];
+    if (seen > target) {
+      break;
+    }
+  }
+  uint64_t end = DeepFuzzy_LatencyBucketStart(bucket + 1) - 1;
+  return end < max_ns ? end : max_ns;
+}
+
+/* Return the end of the last non-empty bucket of the execution time histogram
+ * `counts`, but at most `max_ns`, the longest execution time of any test. */
+static uint64_t DeepFuzzy_LatencyMax(const uint64_t *counts, uint64_t max_ns) {
+  unsigned bucket = DEEPFUZZY_LATENCY_BUCKETS - 1;
+  while (bucket && !counts[bucket]) {
+    bucket--;
+  }
+  uint64_t end = DeepFuzzy_LatencyBucketStart(bucket + 1) - 1;
+  return end < max_ns ? end : max_ns;
+}
+
+/* Combine the execution time histograms of `stats` for all results, minus
+ * those of `prev`, if any, into `counts`. Returns the number of tests. */
+static uint64_t DeepFuzzy_LatencyCounts(uint64_t *counts,
+                                        const struct DeepFuzzy_FuzzStats *stats,
+                                        const struct DeepFuzzy_FuzzStats *prev) {
+  uint64_t total = 0;
+  for (unsigned bucket = 0; bucket < DEEPFUZZY_LATENCY_BUCKETS; bucket++) {
+    counts[bucket] = 0;
+    for (unsigned result = 0; result < DEEPFUZZY_NUM_TEST_RUN_RESULTS; result++) {
+      uint32_t count = stats->exec_ns_hist[result][bucket];
+      if (prev) {
+        count -= prev->exec_ns_hist[result][bucket];
+      }
+      counts[bucket] += count;
+    }
+    total += counts[bucket];
+  }
+  return total;
+}
+
+/* Log a status line for the combined `stats` of all fuzzer workers, `diff`
+ * seconds into fuzzing, followed by the execution times of the tests run in
+ * the `interval_ns` nanoseconds since the counters were `prev`. */
+static void DeepFuzzy_LogFuzzStatus(const struct DeepFuzzy_FuzzStats *stats,
+                                    const struct DeepFuzzy_FuzzStats *prev,
+                                    unsigned diff, uint64_t interval_ns) {
+  time_t t = time(NULL);
+  struct tm tm = *localtime(&t);
+  DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "%d-%02d-%02d %02d:%02d:%02d: %u tests/second: %d failed/%d passed/%d abandoned",
+                      tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                      stats->num_tests / (diff ? diff : 1),
+                      stats->num_failed, stats->num_passed, stats->num_abandoned);
+
+  /* Resources used by the tests since the last report. */
+  struct DeepFuzzy_TestUsage usage = stats->usage;
+  usage.num_tests -= prev->usage.num_tests;
+  usage.user_us -= prev->usage.user_us;
+  usage.sys_us -= prev->usage.sys_us;
+  usage.minor_faults -= prev->usage.minor_faults;
+  usage.major_faults -= prev->usage.major_faults;
+  usage.voluntary_switches -= prev->usage.voluntary_switches;
+  usage.involuntary_switches -= prev->usage.involuntary_switches;
+  DeepFuzzy_LogTestUsage(DeepFuzzy_LogInfo, &usage);
+
+  uint64_t counts[DEEPFUZZY_LATENCY_BUCKETS];
+  uint64_t total = DeepFuzzy_LatencyCounts(counts, stats, prev);
+  if (!total || !interval_ns) {
+    return;
+  }
+  char p50[32], p99[32], max[32];
+  DeepFuzzy_FormatNanos(p50, sizeof(p50), DeepFuzzy_LatencyPercentile(counts, total, 0.5, stats->max_exec_ns));
+  DeepFuzzy_FormatNanos(p99, sizeof(p99), DeepFuzzy_LatencyPercentile(counts, total, 0.99, stats->max_exec_ns));
+  /* `max_exec_ns` is the longest time since fuzzing started, so bound it by
+   * the slowest tests of this interval. */
+  DeepFuzzy_FormatNanos(max, sizeof(max), DeepFuzzy_LatencyMax(counts, stats->max_exec_ns));
+  DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "Exec time: p50 %s, p99 %s, max %s; %.0f execs/second over the last %.0f seconds",
+                      p50, p99, max, total * 1e9 / interval_ns, interval_ns / 1e9);
+}
+
+/* Log the execution time histogram of each kind of test result in `stats`. */
+static void DeepFuzzy_LogFuzzHistogram(const struct DeepFuzzy_FuzzStats *stats) {
+  static const char *result_names[DEEPFUZZY_NUM_TEST_RUN_RESULTS] = {
+    "passed", "failed", "crashed", "abandoned", "hung", "out-of-memory",
+  };
+  char start[32], end[32], p50[32], p99[32];
+
+  for (unsigned result = 0; result < DEEPFUZZY_NUM_TEST_RUN_RESULTS; result++) {
+    uint64_t counts[DEEPFUZZY_LATENCY_BUCKETS];
+    uint64_t total = 0;
+    for (unsigned bucket = 0; bucket < DEEPFUZZY_LATENCY_BUCKETS; bucket++) {
+      counts[bucket] = stats->exec_ns_hist[result][bucket];
+      total += counts[bucket];
+    }
+    if (!total) {
+      continue;
+    }
+
+    DeepFuzzy_FormatNanos(p50, sizeof(p50), DeepFuzzy_LatencyPercentile(counts, total, 0.5, stats->max_exec_ns));
+    DeepFuzzy_FormatNanos(p99, sizeof(p99), DeepFuzzy_LatencyPercentile(counts, total, 0.99, stats->max_exec_ns));
+    DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "Exec time of %llu %s tests: p50 %s, p99 %s",
+                        (unsigned long long) total, result_names[result], p50, p99);
+
+    for (unsigned bucket = 0; bucket < DEEPFUZZY_LATENCY_BUCKETS; bucket++) {
+      if (!counts[bucket]) {
+        continue;
+      }
+      DeepFuzzy_FormatNanos(start, sizeof(start), DeepFuzzy_LatencyBucketStart(bucket));
+      if (bucket == DEEPFUZZY_LATENCY_BUCKETS - 1) {
+        snprintf(end, sizeof(end), "...");
+      } else {
+        DeepFuzzy_FormatNanos(end, sizeof(end), DeepFuzzy_LatencyBucketStart(bucket + 1));
+      }
+      DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "  [%s, %s): %llu (%.2f%%)",
+                          start, end, (unsigned long long) counts[bucket],
+                          100.0 * counts[bucket] / total);
+    }
+  }
+}
+
+/* Sum up the counters of `num_workers` fuzzer workers into `total`. */
+static void DeepFuzzy_SumFuzzStats(struct DeepFuzzy_FuzzStats *total,
+                                   const struct DeepFuzzy_FuzzStats *stats,
+                                   unsigned num_workers) {
+  memset(total, 0, sizeof(*total));
+  for (unsigned i = 0; i < num_workers; i++) {
+    total->num_tests += stats[i].num_tests;
+    total->num_failed += stats[i].num_failed;
+    total->num_passed += stats[i].num_passed;
+    total->num_abandoned += stats[i].num_abandoned;
+    if (stats[i].max_exec_ns > total->max_exec_ns) {
+      total->max_exec_ns = stats[i].max_exec_ns;
+    }
+    DeepFuzzy_AddTestUsage(&(total->usage), &(stats[i].usage));
+    for (unsigned result = 0; result < DEEPFUZZY_NUM_TEST_RUN_RESULTS; result++) {
+      for (unsigned bucket = 0; bucket < DEEPFUZZY_LATENCY_BUCKETS; bucket++) {
+        total->exec_ns_hist[result][bucket] += stats[i].exec_ns_hist[result][bucket];
+      }
+    }
+  }
+}
+
+/* Fuzz `test` until `FLAGS_timeout` seconds after `start_ns`, counting results
+ * and execution times in `stats`. Only a lone worker reports its own progress;
+ * otherwise the parent process reports for all workers. */
+static void DeepFuzzy_FuzzLoop(struct DeepFuzzy_TestInfo *test,
+                               struct DeepFuzzy_FuzzStats *stats,
+                               uint64_t start_ns, int report_status) {
+  uint64_t timeout_ns = (uint64_t) FLAGS_timeout * 1000000000ULL;
+  uint64_t interval_ns = (uint64_t) FLAGS_fuzz_stats_interval * 1000000000ULL;
+  uint64_t now = DeepFuzzy_MonotonicNanos();
+  uint64_t last_status = start_ns;
+  struct DeepFuzzy_FuzzStats prev;
+  memset(&prev, 0, sizeof(prev));
+
+  while (now - start_ns < timeout_ns) {
+    stats->num_tests++;
+    if (report_status && interval_ns && (now - last_status >= interval_ns)) {
+      DeepFuzzy_LogFuzzStatus(stats, &prev, (unsigned) ((now - start_ns) / 1000000000ULL),
+                              now - last_status);
+      prev = *stats;
+      last_status = now;
+    }
+    enum DeepFuzzy_TestRunResult result = DeepFuzzy_FuzzOneTestCase(test);
+    DeepFuzzy_AddTestUsage(&(stats->usage), &DeepFuzzy_LastTestUsage);
+    if (DeepFuzzy_IsFailingResult(result)) {
+      stats->num_failed++;
+    } else if (result == DeepFuzzy_TestRunPass) {
+      stats->num_passed++;
+    } else if (result == DeepFuzzy_TestRunAbandon) {
+      stats->num_abandoned++;
+    }
+
+    uint64_t end = DeepFuzzy_MonotonicNanos();
+    uint64_t exec_ns = end - now;
+    if ((unsigned) result < DEEPFUZZY_NUM_TEST_RUN_RESULTS) {
+      stats->exec_ns_hist[result][DeepFuzzy_LatencyBucket(exec_ns)]++;
+    }
+    if (exec_ns > stats->max_exec_ns) {
+      stats->max_exec_ns = exec_ns;
+    }
+    now = end;
+  }
+}
+
 /* Fuzz test `FLAGS_input_which_test` or first test, if not defined.
    Has to be defined here since we redefine rand in the header. */
 int DeepFuzzy_Fuzz(void){
@@ -859,32 +2046,25 @@ int DeepFuzzy_Fuzz(void){
     FLAGS_min_log_level = 2;
   }
 
+  unsigned int seed = 0;
   if (HAS_FLAG_seed) {
-    srand(FLAGS_seed);
+    seed = FLAGS_seed;
   } else {
-    unsigned int seed = time(NULL);
+    seed = time(NULL);
     DeepFuzzy_LogFormat(DeepFuzzy_LogWarning, "No seed provided; using %u", seed);
-    srand(seed);
   }
 
+  /* Forking the whole harness for each test is too slow for fuzzing, but a
+   * fork server is fine. */
   if (HAS_FLAG_fork) {
-    if (FLAGS_fork) {
+    if (FLAGS_fork && !FLAGS_fork_server) {
       DeepFuzzy_LogFormat(DeepFuzzy_LogFatal,
 			  "Forking should not be combined with brute force fuzzing.");
     }
   } else {
-    FLAGS_fork = 0;
+    FLAGS_fork = FLAGS_fork_server;
   }
 
-  long start = (long)time(NULL);
-  long current = (long)time(NULL);
-  unsigned diff = 0;
-  unsigned int i = 0;
-
-  int num_failed_tests = 0;
-  int num_passed_tests = 0;
-  int num_abandoned_tests = 0;
-
   struct DeepFuzzy_TestInfo *test = NULL;
 
 
@@ -908,34 +2088,113 @@ int DeepFuzzy_Fuzz(void){
     return 0;
   }
 
-  unsigned int last_status = 0;
+  if (FLAGS_coverage) {
+    if (FLAGS_fork) {
+      DeepFuzzy_LogFormat(DeepFuzzy_LogWarning,
+                          "Coverage-guided fuzzing requires --no_fork; ignoring --coverage");
+    } else {
+      DeepFuzzy_CoverageGuided = DeepFuzzy_InitCoverage();
+    }
+  }
 
-  while (diff < FLAGS_timeout) {
-    i++;
-    if ((diff != last_status) && ((diff % 30) == 0) ) {
-      time_t t = time(NULL);
-      struct tm tm = *localtime(&t);
-      DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "%d-%02d-%02d %02d:%02d:%02d: %u tests/second: %d failed/%d passed/%d abandoned",
-			  tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, i/diff,
-			  num_failed_tests, num_passed_tests, num_abandoned_tests);
-      last_status = diff;
+  DeepFuzzy_InitSaveBuckets();
+  DeepFuzzy_InitSearchStats();
+
+  unsigned num_workers = FLAGS_num_workers ? FLAGS_num_workers : 1;
+  struct DeepFuzzy_FuzzStats *stats = (struct DeepFuzzy_FuzzStats *)
+      DeepFuzzy_AllocSharedMemory(num_workers * sizeof(struct DeepFuzzy_FuzzStats));
+  struct DeepFuzzy_FuzzStats total, prev;
+  memset(&prev, 0, sizeof(prev));
+
+  uint64_t start_ns = DeepFuzzy_MonotonicNanos();
+
+  /* Fork the workers, each with its own input stream and test run info, so
+   * that they don't clobber each other's results. */
+  unsigned spawned = 0;
+  if (num_workers > 1) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "Starting %u fuzzer workers", num_workers);
+    for (; spawned < num_workers; spawned++) {
+      int ret = DeepFuzzy_SpawnFuzzWorker();
+      if (ret < 0) {
+        break;
+      } else if (!ret) {
+        DeepFuzzy_AllocCurrentTestRun();
+        DeepFuzzy_SeedFuzzer(seed, spawned);
+        DeepFuzzy_StartSaveWriter();
+        DeepFuzzy_FuzzLoop(test, &(stats[spawned]), start_ns, 0);
+        DeepFuzzy_StopSaveWriter();
+        if (DeepFuzzy_CoverageGuided) {
+          DeepFuzzy_LogCoverageStats();
+        }
+        exit(0);
+      }
     }
-    enum DeepFuzzy_TestRunResult result = DeepFuzzy_FuzzOneTestCase(test);
-    if ((result == DeepFuzzy_TestRunFail) || (result == DeepFuzzy_TestRunCrash)) {
-      num_failed_tests++;
-    } else if (result == DeepFuzzy_TestRunPass) {
-      num_passed_tests++;
-    } else if (result == DeepFuzzy_TestRunAbandon) {
-      num_abandoned_tests++;
+    if (!spawned) {
+      DeepFuzzy_LogFormat(DeepFuzzy_LogWarning,
+                          "Unable to start %u fuzzer workers; fuzzing with one worker",
+                          num_workers);
+    } else if (spawned < num_workers) {
+      DeepFuzzy_LogFormat(DeepFuzzy_LogWarning,
+                          "Only started %u of %u fuzzer workers", spawned, num_workers);
+    }
+  }
+
+  if (!spawned) {
+    DeepFuzzy_SeedFuzzer(seed, 0);
+    DeepFuzzy_StartSaveWriter();
+    DeepFuzzy_FuzzLoop(test, stats, start_ns, 1);
+    DeepFuzzy_StopSaveWriter();
+    spawned = 1;
+    if (DeepFuzzy_CoverageGuided) {
+      DeepFuzzy_LogCoverageStats();
     }
 
-    current = (long)time(NULL);
-    diff = current-start;
+  } else {
+    uint64_t interval_ns = (uint64_t) FLAGS_fuzz_stats_interval * 1000000000ULL;
+    uint64_t last_status = start_ns;
+    int stop_status = 0;
+    for (;;) {
+      unsigned running = DeepFuzzy_ReapFuzzWorkers(1000, &stop_status);
+
+      /* A worker stopped early, e.g. due to `--exit_on_fail` or
+       * `--abort_on_fail`, so stop all of them the same way. */
+      if (stop_status) {
+        DeepFuzzy_KillFuzzWorkers();
+        if (stop_status < 0) {
+          DeepFuzzy_LogFormat(DeepFuzzy_LogError,
+                              "Fuzzer worker terminated by signal %d", -stop_status);
+          signal(-stop_status, SIG_DFL);
+          raise(-stop_status);
+        }
+        exit(stop_status);
+      }
+
+      if (!running) {
+        break;
+      }
+
+      uint64_t now = DeepFuzzy_MonotonicNanos();
+      if (interval_ns && (now - last_status >= interval_ns)) {
+        DeepFuzzy_SumFuzzStats(&total, stats, spawned);
+        DeepFuzzy_LogFuzzStatus(&total, &prev, (unsigned) ((now - start_ns) / 1000000000ULL),
+                                now - last_status);
+        prev = total;
+        last_status = now;
+      }
+    }
   }
 
+  uint64_t elapsed_ns = DeepFuzzy_MonotonicNanos() - start_ns;
+  unsigned diff = (unsigned) (elapsed_ns / 1000000000ULL);
+  DeepFuzzy_SumFuzzStats(&total, stats, spawned);
   DeepFuzzy_LogFormat(DeepFuzzy_LogInfo, "Done fuzzing! Ran %u tests (%u tests/second) with %d failed/%d passed/%d abandoned tests",
-		      i, i/diff, num_failed_tests, num_passed_tests, num_abandoned_tests);
-  return num_failed_tests;
+		      total.num_tests, total.num_tests / (diff ? diff : 1),
+		      total.num_failed, total.num_passed, total.num_abandoned);
+  DeepFuzzy_LogFuzzHistogram(&total);
+  DeepFuzzy_LogTestUsage(DeepFuzzy_LogInfo, &(total.usage));
+  DeepFuzzy_LogSaveBuckets();
+  DeepFuzzy_LogSearchStats();
+  return total.num_failed;
 }
 
 
@@ -946,11 +2205,19 @@ enum DeepFuzzy_TestRunResult DeepFuzzy_FuzzOneTestCase(struct DeepFuzzy_TestInfo
   DeepFuzzy_InputInitialized = 0;
   DeepFuzzy_SwarmConfigsIndex = 0;
   DeepFuzzy_InternalFuzzing = 1;
+  DeepFuzzy_SeedFuzzInput();
+  if (DeepFuzzy_CoverageGuided) {
+    DeepFuzzy_CoverageMutateInput();
+  }
 
   DeepFuzzy_Begin(test);
 
   enum DeepFuzzy_TestRunResult result = DeepFuzzy_ForkAndRunTest(test);
 
+  if (DeepFuzzy_CoverageGuided) {
+    DeepFuzzy_CoverageUpdate(result);
+  }
+
   if (result == DeepFuzzy_TestRunCrash) {
     DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Crashed: %s", test->test_name);
 
@@ -961,13 +2228,27 @@ enum DeepFuzzy_TestRunResult DeepFuzzy_FuzzOneTestCase(struct DeepFuzzy_TestInfo
     DeepFuzzy_Crash();
   }
 
-  if (FLAGS_abort_on_fail && ((result == DeepFuzzy_TestRunCrash) ||
-                  (result == DeepFuzzy_TestRunFail))) {
+  if (result == DeepFuzzy_TestRunHang) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Timed out: %s", test->test_name);
+
+    if (HAS_FLAG_output_test_dir) {
+      DeepFuzzy_SaveHangingTest();
+    }
+  }
+
+  if (result == DeepFuzzy_TestRunOOM) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Out of memory: %s", test->test_name);
+
+    if (HAS_FLAG_output_test_dir) {
+      DeepFuzzy_SaveOutOfMemoryTest();
+    }
+  }
+
+  if (FLAGS_abort_on_fail && DeepFuzzy_IsFailingResult(result)) {
     DeepFuzzy_HardCrash();
   }
 
-  if (FLAGS_exit_on_fail && ((result == DeepFuzzy_TestRunCrash) ||
-                  (result == DeepFuzzy_TestRunFail))) {
+  if (FLAGS_exit_on_fail && DeepFuzzy_IsFailingResult(result)) {
     exit(255); // Terminate the testing
   }
 
@@ -975,7 +2256,7 @@ enum DeepFuzzy_TestRunResult DeepFuzzy_FuzzOneTestCase(struct DeepFuzzy_TestInfo
 }
 
 extern int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
-  if (Size > sizeof(DeepFuzzy_Input)) {
+  if (Size > DeepFuzzy_InputSize) {
     return 0; // Just ignore any too-big inputs
   }
 
@@ -996,6 +2277,7 @@ extern int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
   struct DeepFuzzy_TestInfo *test = NULL;
 
   DeepFuzzy_InitOptions(0, "");
+  DeepFuzzy_SelectReadPath();
   DeepFuzzy_Setup();
 
   /* we also want to manually allocate CurrentTestRun */
@@ -1027,19 +2309,18 @@ extern int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
 
   DeepFuzzy_Begin(test);
 
-  enum DeepFuzzy_TestRunResult result = DeepFuzzy_RunTestNoFork(test);
-  DeepFuzzy_CleanUp();
+  enum DeepFuzzy_TestRunResult result = DeepFuzzy_RunTestInProcess(test);
 
   const char* abort_check = getenv("LIBFUZZER_ABORT_ON_FAIL");
   if (abort_check != NULL) {
-    if ((result == DeepFuzzy_TestRunFail) || (result == DeepFuzzy_TestRunCrash)) {
+    if (DeepFuzzy_IsFailingResult(result)) {
       assert(0); // Terminate the testing more permanently
     }
   }
 
   const char* exit_check = getenv("LIBFUZZER_EXIT_ON_FAIL");
   if (exit_check != NULL) {
-    if ((result == DeepFuzzy_TestRunFail) || (result == DeepFuzzy_TestRunCrash)) {
+    if (DeepFuzzy_IsFailingResult(result)) {
       exit(255); // Terminate the testing
     }
   }
@@ -1055,8 +2336,17 @@ extern int FuzzerEntrypoint(const uint8_t *data, size_t size) {
   return LLVMFuzzerTestOneInput(data, size);
 }
 
-/* Overwrite libc's abort. */
+int DeepFuzzy_AllocationFailed(void) {
+  return DeepFuzzy_TestMemoryLimited && errno == ENOMEM;
+}
+
+/* Overwrite libc's abort. An uncaught `std::bad_alloc`, or a failed
+ * allocation caught by an assertion, lands here with `errno` still set by the
+ * allocator. */
 void abort(void) {
+  if (DeepFuzzy_AllocationFailed()) {
+    DeepFuzzy_OutOfMemory();
+  }
   DeepFuzzy_Fail();
 }
 
@@ -32,6 +32,178 @@ extern void DeepFuzzy_RunSavedTakeOverCases(jmp_buf env, struct DeepFuzzy_TestIn
 /* Run take over. Platform specific function. */
 extern int DeepFuzzy_TakeOver(void);
 
+/* Run `test` in this process, then reset DeepFuzzy's and the harness's state
+ * with `DeepFuzzy_ResetState`. With `--check_reset`, the test is run twice
+ * on the same input, and treated as failing if the runs differ. */
+extern enum DeepFuzzy_TestRunResult
+DeepFuzzy_RunTestInProcess(struct DeepFuzzy_TestInfo *test);
+
+/* Size of a cache line, used to keep per-worker data apart. */
+#define DEEPFUZZY_CACHE_LINE_SIZE 64
+
+/* Number of distinct `DeepFuzzy_TestRunResult`s. */
+#define DEEPFUZZY_NUM_TEST_RUN_RESULTS (DeepFuzzy_TestRunOOM + 1)
+
+/* Test execution times are recorded in log-linear buckets: values below
+ * `2 * DEEPFUZZY_LATENCY_SUB_BUCKETS` nanoseconds get a bucket each, and every
+ * larger power of two is split into `DEEPFUZZY_LATENCY_SUB_BUCKETS` buckets,
+ * giving a relative error of at most 1/8. Times of `2^DEEPFUZZY_LATENCY_MAX_LOG2`
+ * nanoseconds (about 78 hours) or more go into the last bucket. */
+#define DEEPFUZZY_LATENCY_SUB_BUCKET_BITS 3
+#define DEEPFUZZY_LATENCY_SUB_BUCKETS (1 << DEEPFUZZY_LATENCY_SUB_BUCKET_BITS)
+#define DEEPFUZZY_LATENCY_MAX_LOG2 48
+#define DEEPFUZZY_LATENCY_BUCKETS \
+  ((DEEPFUZZY_LATENCY_MAX_LOG2 - DEEPFUZZY_LATENCY_SUB_BUCKET_BITS + 1) * \
+   DEEPFUZZY_LATENCY_SUB_BUCKETS)
+
+/* Counters of one built-in fuzzer worker. Each worker owns one of these in
+ * shared memory, and the parent process sums them up for reporting. */
+struct DEEPFUZZY_ALIGNED(DEEPFUZZY_CACHE_LINE_SIZE) DeepFuzzy_FuzzStats {
+  volatile uint32_t num_tests;
+  volatile uint32_t num_failed;
+  volatile uint32_t num_passed;
+  volatile uint32_t num_abandoned;
+  volatile uint64_t max_exec_ns;
+  volatile uint32_t exec_ns_hist[DEEPFUZZY_NUM_TEST_RUN_RESULTS][DEEPFUZZY_LATENCY_BUCKETS];
+  struct DeepFuzzy_TestUsage usage;
+};
+
+/* Length of the names of saved tests, without extension: 32 hex digits of a
+ * hash of the test's input. */
+#define DEEPFUZZY_TEST_NAME_LEN 32
+
+/* Create `name` in the output test directory with the `size` bytes at `data`,
+ * optionally syncing it to disk. Returns `0`, `EEXIST` if the file exists
+ * already, or `-1` on other errors. Doesn't log, so that it is safe to call
+ * from the save writer thread. */
+extern int DeepFuzzy_WriteTestFile(const char *name, const uint8_t *data,
+                                   size_t size, bool sync);
+
+/* Start or stop the background thread that saves passing tests with
+ * `--async_save`. Stopping waits for all queued tests to be saved. */
+extern void DeepFuzzy_StartSaveWriter(void);
+extern void DeepFuzzy_StopSaveWriter(void);
+
+/* Queue a test to be saved by the save writer thread. Returns `false` if the
+ * writer isn't running. */
+extern bool DeepFuzzy_QueueSave(const char *name, const uint8_t *data, size_t size);
+
+/* Start `fn` in the save writer thread, or wait for it to return. Returns
+ * `false` if the thread could not be started. Platform specific functions. */
+extern bool DeepFuzzy_StartSaveWriterThread(void (*fn)(void));
+extern void DeepFuzzy_JoinSaveWriterThread(void);
+
+/* Set in a test process whose address space is limited to `--rss_limit_mb`,
+ * in which a failing allocation sets `errno` to `ENOMEM`. */
+extern int DeepFuzzy_TestMemoryLimited;
+
+/* Returns non-zero if an allocation failed against the `--rss_limit_mb`
+ * limit during the current test. */
+extern int DeepFuzzy_AllocationFailed(void);
+
+/* Sleep for `micros` microseconds. Platform specific function. */
+extern void DeepFuzzy_SleepMicros(unsigned micros);
+
+/* Flush the data of the file `fp` to disk. Returns non-zero on failure.
+ * Platform specific function. */
+extern int DeepFuzzy_SyncFile(FILE *fp);
+
+#ifndef DEEPFUZZY_MAX_SAVE_BUCKETS
+#define DEEPFUZZY_MAX_SAVE_BUCKETS 4096
+#endif
+
+/* A distinct failure or crash found while fuzzing, identified by the hash of
+ * its description: the failure location, or the crashing signal and program
+ * counter. Buckets are kept in shared memory, so that all fuzzer workers and
+ * forked tests count towards the same limits. */
+struct DeepFuzzy_SaveBucket {
+  uint64_t signature;
+  uint32_t hits;
+  uint32_t saves;
+  uint32_t smallest;
+  char description[DEEPFUZZY_MAX_FAIL_LOCATION + 48];
+};
+
+/* Allocate `size` bytes of zeroed memory that end right before an inaccessible
+ * guard page, so that overflowing them faults. Returns `NULL` on failure.
+ * Platform specific function. */
+extern void *DeepFuzzy_AllocGuardedMemory(size_t size);
+
+/* Return the time in nanoseconds on a monotonic clock. Platform specific
+ * function. */
+extern uint64_t DeepFuzzy_MonotonicNanos(void);
+
+/* Allocate `size` bytes of zeroed memory that remains shared with processes
+ * forked afterwards. Platform specific function. */
+extern void *DeepFuzzy_AllocSharedMemory(size_t size);
+
+/* Fork a built-in fuzzer worker. Returns `0` in the worker, a positive value
+ * in the parent, and a negative value if the worker could not be started.
+ * Platform specific function. */
+extern int DeepFuzzy_SpawnFuzzWorker(void);
+
+/* Wait up to `wait_ms` milliseconds, then reap any finished fuzzer workers.
+ * Returns the number of workers still running. If a worker stopped due to a
+ * failure, `*stop_status` is set to its exit status, or to the negated number
+ * of the signal that killed it. Platform specific function. */
+extern unsigned DeepFuzzy_ReapFuzzWorkers(unsigned wait_ms, int *stop_status);
+
+/* Terminate all running fuzzer workers. Platform specific function. */
+extern void DeepFuzzy_KillFuzzWorkers(void);
+
+/* Return the next random number from the built-in fuzzer's input generator. */
+extern uint64_t DeepFuzzy_FuzzRandom(void);
+
+/* Get or set the state of the built-in fuzzer's input generator, e.g. to pass
+ * it to another process. */
+extern void DeepFuzzy_GetFuzzInputState(uint64_t state[4]);
+extern void DeepFuzzy_SetFuzzInputState(const uint64_t state[4]);
+
+DECLARE_bool(fork_server);
+
+DECLARE_bool(coverage);
+
+/* Prepare for coverage-guided fuzzing. Returns `false` if the harness was not
+ * built with `-fsanitize-coverage` instrumentation. */
+extern bool DeepFuzzy_InitCoverage(void);
+
+/* Start the next fuzzed input with a mutated corpus entry, if any. */
+extern void DeepFuzzy_CoverageMutateInput(void);
+
+/* Collect the coverage of the last test, and add its input to the corpus if it
+ * reached new coverage. Returns `true` if it did. */
+extern bool DeepFuzzy_CoverageUpdate(enum DeepFuzzy_TestRunResult result);
+
+/* Log the size of the corpus and the number of counters hit. */
+extern void DeepFuzzy_LogCoverageStats(void);
+
+/* Abandon this test due to a failed assumption, without logging an error. */
+DEEPFUZZY_NORETURN
+extern void DeepFuzzy_Abandon_Due_to_Assumption(const char *reason);
+
+/* Give the current test its full `--max_search_iters` budget of values to try
+ * in `ASSIGN_SATISFYING` searches. */
+extern void DeepFuzzy_ResetSearchBudget(void);
+
+/* Allocate the shared counters of searches that ran out of budget, or log the
+ * call sites that did. */
+extern void DeepFuzzy_InitSearchStats(void);
+extern void DeepFuzzy_LogSearchStats(void);
+
+/* Open the `--trace_reads` trace, unless it's open already. Returns `false`
+ * if no trace was asked for. */
+extern bool DeepFuzzy_OpenTrace(void);
+
+/* Write a `DeepFuzzy_TraceBits` record for `num_bits` bits of the compact
+ * encoding, read from the `width` input bytes at `offset`. */
+extern void DeepFuzzy_TraceBitsRead(uint32_t offset, uint32_t width,
+                                    unsigned num_bits, uint64_t value,
+                                    uint64_t site);
+
+/* Write out the output of `printf` and friends buffered with `--buffer_log`,
+ * e.g. before forking or when a test crashes. */
+extern void DeepFuzzy_FlushLog(void);
+
 
 DEEPFUZZY_END_EXTERN_C
 
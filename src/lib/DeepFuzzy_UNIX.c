@@ -14,11 +14,24 @@
  * limitations under the License.
  */
 
+/* For the register names in `ucontext_t`. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "deepfuzzy/Platform.h"
 #include "deepfuzzy/Option.h"
 #include "deepfuzzy/Log.h"
 #include "DeepFuzzy.h"
 
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+
 DEEPFUZZY_BEGIN_EXTERN_C
 
 void DeepFuzzy_AllocCurrentTestRun(void) {
@@ -35,6 +48,198 @@ void DeepFuzzy_AllocCurrentTestRun(void) {
   DeepFuzzy_CurrentTestRun = (struct DeepFuzzy_TestRunInfo *) shared_mem;
 }
 
+void *DeepFuzzy_AllocGuardedMemory(size_t size) {
+  size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+  size_t mapped_size = (size + page_size - 1) / page_size * page_size;
+
+  /* Map a guard page on both sides, and place the buffer at the end of the
+   * accessible pages. */
+  uint8_t *mem = (uint8_t *) mmap(NULL, mapped_size + 2 * page_size, PROT_NONE,
+                                  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (mem == MAP_FAILED) {
+    return NULL;
+  }
+  if (mprotect(mem + page_size, mapped_size, PROT_READ | PROT_WRITE)) {
+    munmap(mem, mapped_size + 2 * page_size);
+    return NULL;
+  }
+  return mem + page_size + (mapped_size - size);
+}
+
+void *DeepFuzzy_AllocSharedMemory(size_t size) {
+  int mem_prot = PROT_READ | PROT_WRITE;
+  int mem_vis = MAP_ANONYMOUS | MAP_SHARED;
+  void *shared_mem = mmap(NULL, size, mem_prot, mem_vis, -1, 0);
+
+  if (shared_mem == MAP_FAILED) {
+    DeepFuzzy_Log(DeepFuzzy_LogError, "Unable to map shared memory");
+    exit(1);
+  }
+
+  return shared_mem;
+}
+
+uint64_t DeepFuzzy_MonotonicNanos(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+static pthread_t DeepFuzzy_SaveWriterThread;
+
+static void *DeepFuzzy_RunSaveWriterThread(void *fn) {
+  ((void (*)(void)) fn)();
+  return NULL;
+}
+
+bool DeepFuzzy_StartSaveWriterThread(void (*fn)(void)) {
+  return !pthread_create(&DeepFuzzy_SaveWriterThread, NULL,
+                         DeepFuzzy_RunSaveWriterThread, (void *) fn);
+}
+
+void DeepFuzzy_JoinSaveWriterThread(void) {
+  pthread_join(DeepFuzzy_SaveWriterThread, NULL);
+}
+
+void DeepFuzzy_SleepMicros(unsigned micros) {
+  struct timespec wait_time;
+  wait_time.tv_sec = micros / 1000000;
+  wait_time.tv_nsec = (long) (micros % 1000000) * 1000;
+  while (nanosleep(&wait_time, &wait_time) && errno == EINTR) {}
+}
+
+int DeepFuzzy_SyncFile(FILE *fp) {
+  return fsync(fileno(fp));
+}
+
+/* Set while the `--exec_timeout_ms` timer of a test run in this process is
+ * armed, and once it has expired. */
+static volatile sig_atomic_t DeepFuzzy_ExecTimerArmed = 0;
+static volatile sig_atomic_t DeepFuzzy_ExecTimerExpired = 0;
+
+/* Interrupt a test that ran out of time. `SA_NODEFER` keeps `SIGALRM`
+ * unblocked after jumping out of the handler. */
+static void DeepFuzzy_OnExecTimer(int sig) {
+  (void) sig;
+  if (!DeepFuzzy_ExecTimerArmed) {
+    return;
+  }
+  DeepFuzzy_ExecTimerArmed = 0;
+  DeepFuzzy_ExecTimerExpired = 1;
+  DeepFuzzy_CurrentTestRun->result = DeepFuzzy_TestRunHang;
+  longjmp(DeepFuzzy_ReturnToRun, 1);
+}
+
+static void DeepFuzzy_SetExecTimer(unsigned timeout_ms) {
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  timer.it_value.tv_sec = timeout_ms / 1000;
+  timer.it_value.tv_usec = (timeout_ms % 1000) * 1000;
+  setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+void DeepFuzzy_StartExecTimer(void) {
+  if (!FLAGS_exec_timeout_ms) {
+    return;
+  }
+
+  static bool installed = false;
+  if (!installed) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = DeepFuzzy_OnExecTimer;
+    action.sa_flags = SA_NODEFER;
+    sigaction(SIGALRM, &action, NULL);
+    installed = true;
+  }
+
+  DeepFuzzy_ExecTimerExpired = 0;
+  DeepFuzzy_ExecTimerArmed = 1;
+  DeepFuzzy_SetExecTimer(FLAGS_exec_timeout_ms);
+}
+
+bool DeepFuzzy_StopExecTimer(void) {
+  if (!FLAGS_exec_timeout_ms) {
+    return false;
+  }
+  DeepFuzzy_ExecTimerArmed = 0;
+  DeepFuzzy_SetExecTimer(0);
+  return DeepFuzzy_ExecTimerExpired;
+}
+
+/* Process IDs of the running built-in fuzzer workers. */
+static pid_t *DeepFuzzy_FuzzWorkers = NULL;
+static unsigned DeepFuzzy_NumFuzzWorkers = 0;
+static unsigned DeepFuzzy_MaxFuzzWorkers = 0;
+
+int DeepFuzzy_SpawnFuzzWorker(void) {
+  if (DeepFuzzy_NumFuzzWorkers == DeepFuzzy_MaxFuzzWorkers) {
+    unsigned max_workers = DeepFuzzy_MaxFuzzWorkers ? 2 * DeepFuzzy_MaxFuzzWorkers : 16;
+    pid_t *workers = (pid_t *) realloc(DeepFuzzy_FuzzWorkers,
+                                       max_workers * sizeof(pid_t));
+    if (workers == NULL) {
+      return -1;
+    }
+    DeepFuzzy_FuzzWorkers = workers;
+    DeepFuzzy_MaxFuzzWorkers = max_workers;
+  }
+
+  /* Don't duplicate buffered output in the worker. */
+  DeepFuzzy_FlushLog();
+  fflush(stdout);
+  fflush(stderr);
+
+  pid_t worker_pid = fork();
+  if (worker_pid < 0) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Unable to fork fuzzer worker: %s",
+                        strerror(errno));
+    return -1;
+  } else if (!worker_pid) {
+    return 0;
+  }
+
+  DeepFuzzy_FuzzWorkers[DeepFuzzy_NumFuzzWorkers++] = worker_pid;
+  return 1;
+}
+
+unsigned DeepFuzzy_ReapFuzzWorkers(unsigned wait_ms, int *stop_status) {
+  struct timespec wait_time = {
+    .tv_sec = wait_ms / 1000,
+    .tv_nsec = (wait_ms % 1000) * 1000000L
+  };
+  while (nanosleep(&wait_time, &wait_time) && errno == EINTR) {}
+
+  for (unsigned i = 0; i < DeepFuzzy_NumFuzzWorkers; ) {
+    int wstatus = 0;
+    if (waitpid(DeepFuzzy_FuzzWorkers[i], &wstatus, WNOHANG) <= 0) {
+      ++i;
+      continue;
+    }
+
+    if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus)) {
+      *stop_status = WEXITSTATUS(wstatus);
+    } else if (WIFSIGNALED(wstatus)) {
+      *stop_status = -WTERMSIG(wstatus);
+    }
+
+    /* Order doesn't matter, so fill the hole with the last worker. */
+    DeepFuzzy_FuzzWorkers[i] = DeepFuzzy_FuzzWorkers[--DeepFuzzy_NumFuzzWorkers];
+  }
+
+  return DeepFuzzy_NumFuzzWorkers;
+}
+
+void DeepFuzzy_KillFuzzWorkers(void) {
+  for (unsigned i = 0; i < DeepFuzzy_NumFuzzWorkers; ++i) {
+    kill(DeepFuzzy_FuzzWorkers[i], SIGKILL);
+  }
+  for (unsigned i = 0; i < DeepFuzzy_NumFuzzWorkers; ++i) {
+    waitpid(DeepFuzzy_FuzzWorkers[i], NULL, 0);
+  }
+  DeepFuzzy_NumFuzzWorkers = 0;
+}
+
 /* Return a string path to an input file or directory without parsing it to a type. This is
  * useful method in the case where a tested function only takes a path input in order
  * to generate some specialized structured type. Note: the returned path must be 
@@ -95,6 +300,7 @@ void DeepFuzzy_RunSavedTakeOverCases(jmp_buf env,
     if (DeepFuzzy_IsTestCaseFile(dp->d_name)) {
       DeepFuzzy_InitCurrentTestRun(test);
 
+      DeepFuzzy_FlushLog();
       pid_t case_pid = fork();
       if (!case_pid) {
         DeepFuzzy_Begin(test);
@@ -176,36 +382,437 @@ int DeepFuzzy_TakeOver(void) {
 }
 
 
+/* Input of the test being run by the fork server, shared between the harness,
+ * the fork server, and the test process. The test process copies back the
+ * input it consumed, which may have been generated by the built-in fuzzer. */
+struct DeepFuzzy_ForkServerInput {
+  uint32_t initialized;
+  uint32_t index;
+  uint32_t internal_fuzzing;
+  uint64_t fuzz_state[4];
+  uint8_t data[];  /* `DeepFuzzy_InputSize` bytes. */
+};
+
+static struct DeepFuzzy_ForkServerInput *DeepFuzzy_ForkServerInput = NULL;
+static pid_t DeepFuzzy_ForkServerPid = -1;
+static int DeepFuzzy_ForkServerRequestFd = -1;
+static int DeepFuzzy_ForkServerReplyFd = -1;
+
+/* Signals that terminate a test process abnormally. */
+static const int DeepFuzzy_CrashSignals[] = {
+  SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT, SIGTRAP, SIGSYS
+};
+
+#define DEEPFUZZY_NUM_CRASH_SIGNALS \
+  (sizeof(DeepFuzzy_CrashSignals) / sizeof(DeepFuzzy_CrashSignals[0]))
+
+/* Signal handlers that were installed before ours, e.g. by a sanitizer. */
+static struct sigaction DeepFuzzy_PrevCrashActions[DEEPFUZZY_NUM_CRASH_SIGNALS];
+
+/* Set in a test process forked by the fork server. */
+static int DeepFuzzy_InForkServerTest = 0;
+
+/* Copy the input consumed by the test process back to the harness. */
+static void DeepFuzzy_ForkServerCopyBack(void) {
+  memcpy(DeepFuzzy_ForkServerInput->data, (void *) DeepFuzzy_Input,
+         DeepFuzzy_InputIndex);
+  DeepFuzzy_ForkServerInput->index = DeepFuzzy_InputIndex;
+}
+
+/* Return the program counter at which a signal was raised. */
+static uintptr_t DeepFuzzy_CrashPC(siginfo_t *info, void *context) {
+  ucontext_t *uc = (ucontext_t *) context;
+  (void) info;
+#if defined(__APPLE__) && defined(__x86_64__)
+  return (uintptr_t) uc->uc_mcontext->__ss.__rip;
+#elif defined(__APPLE__) && defined(__aarch64__)
+  return (uintptr_t) uc->uc_mcontext->__ss.__pc;
+#elif defined(__linux__) && defined(__x86_64__)
+  return (uintptr_t) uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__linux__) && defined(__i386__)
+  return (uintptr_t) uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__linux__) && defined(__aarch64__)
+  return (uintptr_t) uc->uc_mcontext.pc;
+#else
+  (void) uc;
+  return (uintptr_t) info->si_addr;
+#endif
+}
+
+/* Record where a test process crashed, for deduplication of saved crashing
+ * tests, then pass the signal on to the previous handler, or let it terminate
+ * the process. */
+static void DeepFuzzy_OnCrash(int sig, siginfo_t *info, void *context) {
+  /* A crash right after an allocation failed under `--rss_limit_mb`, e.g. from
+   * dereferencing the `NULL` that `malloc` returned, is an out of memory. */
+  if (DeepFuzzy_AllocationFailed()) {
+    DeepFuzzy_CurrentTestRun->out_of_memory = 1;
+  }
+  DeepFuzzy_CurrentTestRun->crash_signal = sig;
+  DeepFuzzy_CurrentTestRun->crash_pc = DeepFuzzy_CrashPC(info, context);
+  DeepFuzzy_FlushLog();
+  if (DeepFuzzy_InForkServerTest) {
+    DeepFuzzy_ForkServerCopyBack();
+  }
+
+  for (size_t i = 0; i < DEEPFUZZY_NUM_CRASH_SIGNALS; i++) {
+    if (DeepFuzzy_CrashSignals[i] != sig) {
+      continue;
+    }
+    struct sigaction *prev = &(DeepFuzzy_PrevCrashActions[i]);
+    sigaction(sig, prev, NULL);
+    if ((prev->sa_flags & SA_SIGINFO) && prev->sa_sigaction) {
+      prev->sa_sigaction(sig, info, context);
+    } else if (prev->sa_handler != SIG_DFL && prev->sa_handler != SIG_IGN) {
+      prev->sa_handler(sig);
+    }
+    break;
+  }
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/* Limit the address space of a forked test process to `--rss_limit_mb`, so
+ * that allocations beyond it fail. */
+static void DeepFuzzy_LimitTestMemory(void) {
+  if (!FLAGS_rss_limit_mb) {
+    return;
+  }
+  struct rlimit limit;
+  limit.rlim_cur = (rlim_t) FLAGS_rss_limit_mb << 20;
+  limit.rlim_max = limit.rlim_cur;
+  DeepFuzzy_TestMemoryLimited = !setrlimit(RLIMIT_AS, &limit);
+  errno = 0;
+}
+
+/* Record the resources used by a test process, as reported by `wait4`. */
+static void DeepFuzzy_RecordTestUsage(const struct rusage *ru) {
+  struct DeepFuzzy_TestUsage *usage = &DeepFuzzy_LastTestUsage;
+  usage->num_tests = 1;
+#if defined(__APPLE__)
+  usage->max_rss_kb = (uint64_t) ru->ru_maxrss / 1024;  /* In bytes. */
+#else
+  usage->max_rss_kb = (uint64_t) ru->ru_maxrss;
+#endif
+  usage->user_us = (uint64_t) ru->ru_utime.tv_sec * 1000000 + ru->ru_utime.tv_usec;
+  usage->sys_us = (uint64_t) ru->ru_stime.tv_sec * 1000000 + ru->ru_stime.tv_usec;
+  usage->minor_faults = (uint64_t) ru->ru_minflt;
+  usage->major_faults = (uint64_t) ru->ru_majflt;
+  usage->voluntary_switches = (uint64_t) ru->ru_nvcsw;
+  usage->involuntary_switches = (uint64_t) ru->ru_nivcsw;
+}
+
+/* Install `DeepFuzzy_OnCrash` in a forked test process. */
+static void DeepFuzzy_InstallCrashHandlers(void) {
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_sigaction = DeepFuzzy_OnCrash;
+  action.sa_flags = SA_SIGINFO;
+  for (size_t i = 0; i < DEEPFUZZY_NUM_CRASH_SIGNALS; i++) {
+    sigaction(DeepFuzzy_CrashSignals[i], &action, &(DeepFuzzy_PrevCrashActions[i]));
+  }
+}
+
+/* Time a timed out test process gets to exit after `SIGTERM`, before it is
+ * killed with `SIGKILL`. */
+#define DEEPFUZZY_EXEC_TIMEOUT_GRACE_NS 100000000ULL
+
+/* Signal mask from before `DeepFuzzy_BlockChildSignal`, restored in test
+ * processes. */
+static sigset_t DeepFuzzy_TestSignalMask;
+
+/* Block `SIGCHLD`, so that `DeepFuzzy_WaitForTest` can wait for it. */
+static void DeepFuzzy_BlockChildSignal(void) {
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &set, &DeepFuzzy_TestSignalMask);
+}
+
+static void DeepFuzzy_UnblockChildSignal(void) {
+  sigprocmask(SIG_SETMASK, &DeepFuzzy_TestSignalMask, NULL);
+}
+
+/* Wait up to `wait_ns` nanoseconds for a child process to change state. */
+static void DeepFuzzy_WaitForChildSignal(uint64_t wait_ns) {
+#if defined(__APPLE__)
+  /* No `sigtimedwait`; poll instead. */
+  DeepFuzzy_SleepMicros(wait_ns < 1000000ULL ? (unsigned) (wait_ns / 1000) + 1 : 1000);
+#else
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGCHLD);
+  struct timespec wait_time = {
+    .tv_sec = (time_t) (wait_ns / 1000000000ULL),
+    .tv_nsec = (long) (wait_ns % 1000000000ULL)
+  };
+  sigtimedwait(&set, NULL, &wait_time);
+#endif
+}
+
+/* Wait for the test process `test_pid` to exit, and get the resources it
+ * used. If it runs for longer than `--exec_timeout_ms`, ask it to stop with
+ * `SIGTERM`, and kill it if it doesn't. Returns `true` if the test timed out.
+ * `SIGCHLD` must be blocked with `DeepFuzzy_BlockChildSignal` before forking
+ * the test. */
+static bool DeepFuzzy_WaitForTest(pid_t test_pid, int *wstatus,
+                                  struct rusage *usage) {
+  if (!FLAGS_exec_timeout_ms) {
+    wait4(test_pid, wstatus, 0, usage);
+    return false;
+  }
+
+  bool timed_out = false;
+  uint64_t deadline = DeepFuzzy_MonotonicNanos() +
+                      (uint64_t) FLAGS_exec_timeout_ms * 1000000ULL;
+  for (;;) {
+    pid_t pid = wait4(test_pid, wstatus, WNOHANG, usage);
+    if (pid == test_pid || (pid < 0 && errno != EINTR)) {
+      return timed_out;
+    }
+
+    uint64_t now = DeepFuzzy_MonotonicNanos();
+    if (now < deadline) {
+      DeepFuzzy_WaitForChildSignal(deadline - now);
+    } else if (!timed_out) {
+      kill(test_pid, SIGTERM);
+      timed_out = true;
+      deadline = now + DEEPFUZZY_EXEC_TIMEOUT_GRACE_NS;
+    } else {
+      kill(test_pid, SIGKILL);
+      wait4(test_pid, wstatus, 0, usage);
+      return true;
+    }
+  }
+}
+
+/* Copy back the input consumed so far by a fork server test process that is
+ * being stopped for running too long, so that the harness can save it. */
+static void DeepFuzzy_OnTestTimeout(int sig) {
+  DeepFuzzy_ForkServerCopyBack();
+  DeepFuzzy_FlushLog();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/* Run a test in a process forked by the fork server. */
+DEEPFUZZY_NORETURN
+static void DeepFuzzy_ForkServerRunTest(struct DeepFuzzy_TestInfo *test) {
+  close(DeepFuzzy_ForkServerRequestFd);
+  close(DeepFuzzy_ForkServerReplyFd);
+
+  DeepFuzzy_InForkServerTest = 1;
+  DeepFuzzy_InstallCrashHandlers();
+  atexit(DeepFuzzy_ForkServerCopyBack);
+  if (FLAGS_exec_timeout_ms) {
+    signal(SIGTERM, DeepFuzzy_OnTestTimeout);
+  }
+  DeepFuzzy_UnblockChildSignal();
+  DeepFuzzy_LimitTestMemory();
+
+  struct DeepFuzzy_ForkServerInput *input = DeepFuzzy_ForkServerInput;
+  memcpy((void *) DeepFuzzy_Input, input->data, input->initialized);
+  DeepFuzzy_InputInitialized = input->initialized;
+  DeepFuzzy_InputIndex = 0;
+  DeepFuzzy_SwarmConfigsIndex = 0;
+  DeepFuzzy_InternalFuzzing = input->internal_fuzzing;
+  DeepFuzzy_SetFuzzInputState(input->fuzz_state);
+
+  DeepFuzzy_RunTest(test);
+  exit(DeepFuzzy_TestRunPass);  /* Not reached. */
+}
+
+/* Reply of the fork server for one test. */
+struct DeepFuzzy_ForkServerReply {
+  int wstatus;
+  int timed_out;
+  struct rusage usage;
+};
+
+/* Main loop of the fork server: read the test to run, fork a process to run
+ * it, and reply with the wait status of that process, whether it was stopped
+ * for running longer than `--exec_timeout_ms`, and the resources it used. */
+DEEPFUZZY_NORETURN
+static void DeepFuzzy_ForkServerLoop(void) {
+  struct DeepFuzzy_TestInfo *test = NULL;
+  DeepFuzzy_BlockChildSignal();
+  while (read(DeepFuzzy_ForkServerRequestFd, &test, sizeof(test)) ==
+         sizeof(test)) {
+    struct DeepFuzzy_ForkServerReply reply;
+    memset(&reply, 0, sizeof(reply));
+    pid_t test_pid = fork();
+    if (!test_pid) {
+      DeepFuzzy_ForkServerRunTest(test);
+    } else if (test_pid < 0) {
+      _exit(1);
+    }
+    reply.timed_out = DeepFuzzy_WaitForTest(test_pid, &reply.wstatus, &reply.usage);
+
+    if (write(DeepFuzzy_ForkServerReplyFd, &reply, sizeof(reply)) !=
+        sizeof(reply)) {
+      _exit(1);
+    }
+  }
+
+  /* The harness went away. */
+  _exit(0);
+}
+
+/* Start the fork server, from the current (pristine) state of the harness. */
+static bool DeepFuzzy_StartForkServer(void) {
+  if (DeepFuzzy_ForkServerInput == NULL) {
+    DeepFuzzy_ForkServerInput = (struct DeepFuzzy_ForkServerInput *)
+        DeepFuzzy_AllocSharedMemory(sizeof(struct DeepFuzzy_ForkServerInput) +
+                                    DeepFuzzy_InputSize);
+  }
+
+  int request_pipe[2];
+  int reply_pipe[2];
+  if (pipe(request_pipe)) {
+    return false;
+  }
+  if (pipe(reply_pipe)) {
+    close(request_pipe[0]);
+    close(request_pipe[1]);
+    return false;
+  }
+
+  /* Don't duplicate buffered output in the fork server. */
+  DeepFuzzy_FlushLog();
+  fflush(stdout);
+  fflush(stderr);
+
+  pid_t server_pid = fork();
+  if (server_pid < 0) {
+    close(request_pipe[0]);
+    close(request_pipe[1]);
+    close(reply_pipe[0]);
+    close(reply_pipe[1]);
+    return false;
+
+  } else if (!server_pid) {
+    close(request_pipe[1]);
+    close(reply_pipe[0]);
+    DeepFuzzy_ForkServerRequestFd = request_pipe[0];
+    DeepFuzzy_ForkServerReplyFd = reply_pipe[1];
+    DeepFuzzy_ForkServerLoop();
+  }
+
+  close(request_pipe[0]);
+  close(reply_pipe[1]);
+  DeepFuzzy_ForkServerPid = server_pid;
+  DeepFuzzy_ForkServerRequestFd = request_pipe[1];
+  DeepFuzzy_ForkServerReplyFd = reply_pipe[0];
+  return true;
+}
+
+static void DeepFuzzy_StopForkServer(void) {
+  close(DeepFuzzy_ForkServerRequestFd);
+  close(DeepFuzzy_ForkServerReplyFd);
+  kill(DeepFuzzy_ForkServerPid, SIGKILL);
+  waitpid(DeepFuzzy_ForkServerPid, NULL, 0);
+  DeepFuzzy_ForkServerPid = -1;
+}
+
+/* Run `test` in a process forked by the fork server, starting the fork server
+ * if needed. Returns `false` if the fork server could not run the test. */
+static bool DeepFuzzy_ForkServerRun(struct DeepFuzzy_TestInfo *test,
+                                    struct DeepFuzzy_ForkServerReply *reply) {
+  if (DeepFuzzy_ForkServerPid < 0 && !DeepFuzzy_StartForkServer()) {
+    return false;
+  }
+
+  struct DeepFuzzy_ForkServerInput *input = DeepFuzzy_ForkServerInput;
+  memcpy(input->data, (void *) DeepFuzzy_Input, DeepFuzzy_InputInitialized);
+  input->initialized = DeepFuzzy_InputInitialized;
+  input->index = 0;
+  input->internal_fuzzing = DeepFuzzy_InternalFuzzing;
+  DeepFuzzy_GetFuzzInputState(input->fuzz_state);
+
+  /* Avoid duplicating buffered output in the test process. */
+  DeepFuzzy_FlushLog();
+  fflush(stdout);
+  fflush(stderr);
+
+  if (write(DeepFuzzy_ForkServerRequestFd, &test, sizeof(test)) != sizeof(test) ||
+      read(DeepFuzzy_ForkServerReplyFd, reply, sizeof(*reply)) != sizeof(*reply)) {
+    DeepFuzzy_StopForkServer();
+    return false;
+  }
+
+  /* Pick up the input that the test actually consumed, so that the harness
+   * saves the right input for crashes. */
+  memcpy((void *) DeepFuzzy_Input, input->data, input->index);
+  DeepFuzzy_InputIndex = input->index;
+  if (DeepFuzzy_InputInitialized < input->index) {
+    DeepFuzzy_InputInitialized = input->index;
+  }
+  return true;
+}
+
 /* Fork and run `test`. */
 extern enum DeepFuzzy_TestRunResult
 DeepFuzzy_ForkAndRunTest(struct DeepFuzzy_TestInfo *test) {
   int wstatus = 0;
+  bool timed_out = false;
+  struct rusage usage;
   pid_t test_pid;
-  
-  if (FLAGS_fork) {
+
+  memset(&DeepFuzzy_LastTestUsage, 0, sizeof(DeepFuzzy_LastTestUsage));
+
+  if (FLAGS_fork && FLAGS_fork_server) {
+    /* If the fork server died, e.g. because it was killed, start a new one and
+     * try again once. */
+    struct DeepFuzzy_ForkServerReply reply;
+    memset(&reply, 0, sizeof(reply));
+    if (!DeepFuzzy_ForkServerRun(test, &reply) &&
+        !DeepFuzzy_ForkServerRun(test, &reply)) {
+      DeepFuzzy_Log(DeepFuzzy_LogError, "Unable to run test in fork server");
+      return DeepFuzzy_TestRunCrash;
+    }
+    wstatus = reply.wstatus;
+    timed_out = reply.timed_out;
+    usage = reply.usage;
+  } else if (FLAGS_fork) {
+    DeepFuzzy_BlockChildSignal();
+    DeepFuzzy_FlushLog();
     test_pid = fork();
     if (!test_pid) {
+      DeepFuzzy_UnblockChildSignal();
+      DeepFuzzy_InstallCrashHandlers();
+      DeepFuzzy_LimitTestMemory();
       DeepFuzzy_RunTest(test);
       /* No need to clean up in a fork; exit() is the ultimate garbage collector */
     }
-  }
-  if (FLAGS_fork) {
-    waitpid(test_pid, &wstatus, 0);
+    memset(&usage, 0, sizeof(usage));
+    timed_out = DeepFuzzy_WaitForTest(test_pid, &wstatus, &usage);
+    DeepFuzzy_UnblockChildSignal();
   } else {
-    wstatus = DeepFuzzy_RunTestNoFork(test);
-    DeepFuzzy_CleanUp();
+    wstatus = DeepFuzzy_RunTestInProcess(test);
+    return (enum DeepFuzzy_TestRunResult) wstatus;
   }
 
+  DeepFuzzy_RecordTestUsage(&usage);
+
   /* If we exited normally, the status code tells us if the test passed. */
-  if (!FLAGS_fork) {
-    return (enum DeepFuzzy_TestRunResult) wstatus;
+  if (timed_out) {
+    return DeepFuzzy_TestRunHang;
   } else if (WIFEXITED(wstatus)) {
     uint8_t status = WEXITSTATUS(wstatus);
     return (enum DeepFuzzy_TestRunResult) status;
+  } else if (WIFSIGNALED(wstatus)) {
+    DeepFuzzy_CurrentTestRun->crash_signal = WTERMSIG(wstatus);
   }
 
   /* If here, we exited abnormally but didn't catch it in the signal
-   * handler, and thus the test failed due to a crash. */
+   * handler, and thus the test failed due to a crash; unless it crashed
+   * because it ran out of memory, or was killed for using too much. */
+  if (DeepFuzzy_CurrentTestRun->out_of_memory ||
+      (FLAGS_rss_limit_mb &&
+       DeepFuzzy_LastTestUsage.max_rss_kb >= (uint64_t) FLAGS_rss_limit_mb << 10)) {
+    return DeepFuzzy_TestRunOOM;
+  }
   return DeepFuzzy_TestRunCrash;
 }
 
@@ -239,7 +846,7 @@ void DeepFuzzy_InitInputFromFile(const char *path) {
 
   size_t to_read = stat_buf.st_size;
 
-  if (stat_buf.st_size > sizeof(DeepFuzzy_Input)) {
+  if (stat_buf.st_size > DeepFuzzy_InputSize) {
     DeepFuzzy_LogFormat(DeepFuzzy_LogWarning, "File too large, truncating to max input size");
     to_read = DeepFuzzy_InputSize;
   }
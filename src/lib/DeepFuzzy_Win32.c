@@ -15,6 +15,7 @@
  */
 
 #include <windows.h>
+#include <io.h>
 
 #include "deepfuzzy/Platform.h"
 #include "deepfuzzy/Option.h"
@@ -42,6 +43,103 @@ void DeepFuzzy_AllocCurrentTestRun(void) {
   DeepFuzzy_CurrentTestRun = (struct DeepFuzzy_TestRunInfo *) shared_mem;
 }
 
+void *DeepFuzzy_AllocGuardedMemory(size_t size) {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  size_t page_size = info.dwPageSize;
+  size_t mapped_size = (size + page_size - 1) / page_size * page_size;
+
+  /* Reserve a guard page on both sides, and place the buffer at the end of
+   * the committed pages. */
+  uint8_t *mem = (uint8_t *) VirtualAlloc(NULL, mapped_size + 2 * page_size,
+                                          MEM_RESERVE, PAGE_NOACCESS);
+  if (mem == NULL) {
+    return NULL;
+  }
+  if (!VirtualAlloc(mem + page_size, mapped_size, MEM_COMMIT, PAGE_READWRITE)) {
+    VirtualFree(mem, 0, MEM_RELEASE);
+    return NULL;
+  }
+  return mem + page_size + (mapped_size - size);
+}
+
+void *DeepFuzzy_AllocSharedMemory(size_t size) {
+  HANDLE shared_mem_handle = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                               (DWORD) ((uint64_t) size >> 32),
+                                               (DWORD) size, NULL);
+  if (!shared_mem_handle){
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Unable to map shared memory (%d)", GetLastError());
+    exit(1);
+  }
+
+  void *shared_mem = MapViewOfFile(shared_mem_handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (!shared_mem){
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Unable to map shared memory (%d)", GetLastError());
+    exit(1);
+  }
+
+  return shared_mem;
+}
+
+uint64_t DeepFuzzy_MonotonicNanos(void) {
+  static LARGE_INTEGER frequency;
+  LARGE_INTEGER now;
+  if (!frequency.QuadPart) {
+    QueryPerformanceFrequency(&frequency);
+  }
+  QueryPerformanceCounter(&now);
+  return (uint64_t) (now.QuadPart / frequency.QuadPart) * 1000000000ULL +
+         (uint64_t) (now.QuadPart % frequency.QuadPart) * 1000000000ULL /
+             (uint64_t) frequency.QuadPart;
+}
+
+static HANDLE DeepFuzzy_SaveWriterThread = NULL;
+
+static DWORD WINAPI DeepFuzzy_RunSaveWriterThread(LPVOID fn) {
+  ((void (*)(void)) fn)();
+  return 0;
+}
+
+bool DeepFuzzy_StartSaveWriterThread(void (*fn)(void)) {
+  DeepFuzzy_SaveWriterThread = CreateThread(NULL, 0, DeepFuzzy_RunSaveWriterThread,
+                                            (LPVOID) fn, 0, NULL);
+  return DeepFuzzy_SaveWriterThread != NULL;
+}
+
+void DeepFuzzy_JoinSaveWriterThread(void) {
+  WaitForSingleObject(DeepFuzzy_SaveWriterThread, INFINITE);
+  CloseHandle(DeepFuzzy_SaveWriterThread);
+  DeepFuzzy_SaveWriterThread = NULL;
+}
+
+void DeepFuzzy_SleepMicros(unsigned micros) {
+  Sleep((micros + 999) / 1000);
+}
+
+int DeepFuzzy_SyncFile(FILE *fp) {
+  return _commit(_fileno(fp));
+}
+
+/* Tests run in this process can't be interrupted on Windows; only tests run
+ * in a child process are stopped by `--exec_timeout_ms`. */
+void DeepFuzzy_StartExecTimer(void) {}
+
+bool DeepFuzzy_StopExecTimer(void) {
+  return false;
+}
+
+/* Windows has no `fork`, so the built-in fuzzer always runs as one worker. */
+int DeepFuzzy_SpawnFuzzWorker(void) {
+  return -1;
+}
+
+unsigned DeepFuzzy_ReapFuzzWorkers(unsigned wait_ms, int *stop_status) {
+  Sleep(wait_ms);
+  return 0;
+}
+
+void DeepFuzzy_KillFuzzWorkers(void) {}
+
 
 /* Return a string path to an input file or directory without parsing it to a type. This is
  * useful method in the case where a tested function only takes a path input in order
@@ -129,14 +227,26 @@ int DeepFuzzy_RunTestWin(struct DeepFuzzy_TestInfo *test){
     snprintf(command, MAX_CMD_LEN, "%s --fuzz_save_passing", command);
   }
 
+  if (HAS_FLAG_max_input_size) {
+    snprintf(command, MAX_CMD_LEN, "%s --max_input_size %u", command, FLAGS_max_input_size);
+  }
+
   /* Create the process */
   if(!CreateProcess(NULL, command, NULL, NULL, false, 0, NULL, NULL, &si, &pi)){
     DeepFuzzy_LogFormat(DeepFuzzy_LogError, "CreateProcess failed (%d)", GetLastError());
     return DeepFuzzy_TestRunAbandon;
   }
 
-  /* Wait for the process to complete and get it's exit code */
-  WaitForSingleObject(pi.hProcess, INFINITE);
+  /* Wait for the process to complete and get it's exit code, killing it if
+   * it runs for longer than `--exec_timeout_ms`. */
+  DWORD wait_ms = FLAGS_exec_timeout_ms ? FLAGS_exec_timeout_ms : INFINITE;
+  if (WaitForSingleObject(pi.hProcess, wait_ms) == WAIT_TIMEOUT) {
+    TerminateProcess(pi.hProcess, DeepFuzzy_TestRunHang);
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    return DeepFuzzy_TestRunHang;
+  }
   if (!GetExitCodeProcess(pi.hProcess, &exit_code)){
     DeepFuzzy_LogFormat(DeepFuzzy_LogError, "GetExitCodeProcess failed (%d)", GetLastError());
     return DeepFuzzy_TestRunAbandon;
@@ -190,12 +300,14 @@ extern enum DeepFuzzy_TestRunResult
 DeepFuzzy_ForkAndRunTest(struct DeepFuzzy_TestInfo *test) {
   int wstatus;
 
+  /* Resource usage of test processes isn't collected on Windows. */
+  memset(&DeepFuzzy_LastTestUsage, 0, sizeof(DeepFuzzy_LastTestUsage));
+
   if (FLAGS_fork) {
     wstatus = DeepFuzzy_RunTestWin(test);
     return (enum DeepFuzzy_TestRunResult) wstatus;
   }
-  wstatus = DeepFuzzy_RunTestNoFork(test);
-  DeepFuzzy_CleanUp();
+  wstatus = DeepFuzzy_RunTestInProcess(test);
   return (enum DeepFuzzy_TestRunResult) wstatus;
 }
 
@@ -229,7 +341,7 @@ void DeepFuzzy_InitInputFromFile(const char *path) {
     DeepFuzzy_Abandon("Unable to get test input size");
   }
 
-  if (to_read > sizeof(DeepFuzzy_Input)) {
+  if (to_read > DeepFuzzy_InputSize) {
     DeepFuzzy_LogFormat(DeepFuzzy_LogWarning, "File too large, truncating to max input size");
     to_read = DeepFuzzy_InputSize;
   }
@@ -26,10 +26,12 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "deepfuzzy/DeepFuzzy.h"
 #include "deepfuzzy/Log.h"
+#include "DeepFuzzy.h"
 
 #undef printf
 #undef vprintf
@@ -42,6 +44,8 @@
 
 DEEPFUZZY_BEGIN_EXTERN_C
 
+DEFINE_bool(buffer_log, ExecutionGroup, false, "Buffer the output of printf and friends when not under symbolic execution, and write it to stderr in large chunks.");
+
 /* Returns a printable string version of the log level. */
 static const char *DeepFuzzy_LogLevelStr(enum DeepFuzzy_LogLevel level) {
   switch (level) {
@@ -65,7 +69,8 @@ static const char *DeepFuzzy_LogLevelStr(enum DeepFuzzy_LogLevel level) {
 }
 
 enum {
-  DeepFuzzy_LogBufSize = 4096
+  DeepFuzzy_LogBufSize = 4096,
+  DeepFuzzy_LogSinkSize = 8 * DeepFuzzy_LogBufSize
 };
 
 extern int DeepFuzzy_UsingLibFuzzer;
@@ -73,13 +78,57 @@ extern int DeepFuzzy_LibFuzzerLoud;
 
 char DeepFuzzy_LogBuf[DeepFuzzy_LogBufSize + 1] = {};
 
+/* Lines logged by `printf` and friends with `--buffer_log`, that are yet to be
+ * written to `stderr`. */
+static char DeepFuzzy_LogSink[DeepFuzzy_LogSinkSize];
+static size_t DeepFuzzy_LogSinkUsed = 0;
+
+/* Write out the lines buffered with `--buffer_log`. */
+void DeepFuzzy_FlushLog(void) {
+  size_t used = DeepFuzzy_LogSinkUsed;
+  if (used) {
+    /* Empty the sink first, so that a crash handler flushing it while we
+     * write doesn't repeat the lines. */
+    DeepFuzzy_LogSinkUsed = 0;
+    fwrite(DeepFuzzy_LogSink, 1, used, stderr);
+  }
+}
+
+DEEPFUZZY_INITIALIZER(DeepFuzzy_FlushLogAtExit) {
+  atexit(DeepFuzzy_FlushLog);
+}
+
+/* Returns non-zero if `DeepFuzzy_Log` drops messages at `level`. */
+static int DeepFuzzy_IsLogFiltered(enum DeepFuzzy_LogLevel level) {
+  return ((int) level < FLAGS_min_log_level) &&
+         !(DeepFuzzy_UsingLibFuzzer && level == DeepFuzzy_LogDebug);
+}
+
+/* Remember the `file(line)` prefix of the error message `str`, if it has one,
+ * as the location where the current test failed. */
+static void DeepFuzzy_RecordFailLocation(const char *str) {
+  const char *end = strstr(str, "): ");
+  if (end == NULL || DeepFuzzy_CurrentTestRun == NULL) {
+    return;
+  }
+  const char *begin = end;
+  while (begin > str && begin[-1] >= '0' && begin[-1] <= '9') {
+    begin--;
+  }
+  if (begin == end || begin - 1 <= str || begin[-1] != '(') {
+    return;
+  }
+  snprintf(DeepFuzzy_CurrentTestRun->fail_location, DEEPFUZZY_MAX_FAIL_LOCATION,
+           "%.*s", (int) (end + 1 - str), str);
+}
+
 /* Log a C string. */
 DEEPFUZZY_NOINLINE
 void DeepFuzzy_Log(enum DeepFuzzy_LogLevel level, const char *str) {
-  if ((level < FLAGS_min_log_level) &&
-      !(DeepFuzzy_UsingLibFuzzer && level == 0)) {
+  if (DeepFuzzy_IsLogFiltered(level)) {
     return;
   }
+  DeepFuzzy_FlushLog();
   //Removed because I don't see why we need to zero this before writing
   //to it.
   //DeepFuzzy_MemScrub(DeepFuzzy_LogBuf, DeepFuzzy_LogBufSize);
@@ -88,8 +137,10 @@ void DeepFuzzy_Log(enum DeepFuzzy_LogLevel level, const char *str) {
   fputs(DeepFuzzy_LogBuf, stderr);
 
   if (DeepFuzzy_LogError == level) {
+    DeepFuzzy_RecordFailLocation(str);
     DeepFuzzy_SoftFail();
   } else if (DeepFuzzy_LogFatal == level) {
+    DeepFuzzy_RecordFailLocation(str);
     /* `DeepFuzzy_Fail()` calls `longjmp()`, so we need to make sure
      * we clean up the log buffer first. */
     DeepFuzzy_ClearStream(level);
@@ -101,6 +152,9 @@ void DeepFuzzy_Log(enum DeepFuzzy_LogLevel level, const char *str) {
 DEEPFUZZY_NOINLINE
 void DeepFuzzy_LogVFormat(enum DeepFuzzy_LogLevel level,
                           const char *format, va_list args) {
+  if (!DeepFuzzy_IsLogEnabled(level)) {
+    return;
+  }
   struct DeepFuzzy_VarArgs va;
   va_copy(va.args, args);
   if (DeepFuzzy_UsingLibFuzzer && !DeepFuzzy_LibFuzzerLoud &&
@@ -133,6 +187,61 @@ void DeepFuzzy_LogFormat(enum DeepFuzzy_LogLevel level,
   va_end(args);
 }
 
+/* Log output of the tested code, e.g. from `printf`. The streams only exist
+ * so that symbolic executors can hook the formatting; without one, libc formats
+ * the message straight into the same `LEVEL: message` line that
+ * `DeepFuzzy_Log` would write, and with `--buffer_log` into the sink. */
+static void DeepFuzzy_LogOutput(enum DeepFuzzy_LogLevel level,
+                                const char *format, va_list args) {
+  if (DeepFuzzy_UsingSymExec) {
+    DeepFuzzy_LogVFormat(level, format, args);
+    return;
+  }
+  if (!DeepFuzzy_IsLogEnabled(level) || DeepFuzzy_IsLogFiltered(level) ||
+      (DeepFuzzy_UsingLibFuzzer && !DeepFuzzy_LibFuzzerLoud &&
+       level != DeepFuzzy_LogDebug)) {
+    return;
+  }
+
+  /* Anything left in the stream goes first, as with `DeepFuzzy_LogVFormat`. */
+  DeepFuzzy_LogStream(level);
+
+  char *line = DeepFuzzy_LogBuf;
+  if (FLAGS_buffer_log) {
+    if (DeepFuzzy_LogSinkSize - DeepFuzzy_LogSinkUsed < DeepFuzzy_LogBufSize) {
+      DeepFuzzy_FlushLog();
+    }
+    line = &(DeepFuzzy_LogSink[DeepFuzzy_LogSinkUsed]);
+  }
+
+  /* Truncated to `DeepFuzzy_LogBufSize - 1` bytes, like in `DeepFuzzy_Log`. */
+  const char *level_str = DeepFuzzy_LogLevelStr(level);
+  size_t len = strlen(level_str);
+  memcpy(line, level_str, len);
+  line[len++] = ':';
+  line[len++] = ' ';
+  vsnprintf(&(line[len]), DeepFuzzy_LogBufSize - len, format, args);
+  len += strlen(&(line[len]));
+  if (len < DeepFuzzy_LogBufSize - 1) {
+    line[len++] = '\n';
+  }
+
+  if (FLAGS_buffer_log) {
+    DeepFuzzy_LogSinkUsed += len;
+  } else {
+    fwrite(line, 1, len, stderr);
+  }
+}
+
+/* Log output of the tested code with a variable number of arguments. */
+static void DeepFuzzy_LogOutputFormat(enum DeepFuzzy_LogLevel level,
+                                      const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  DeepFuzzy_LogOutput(level, format, args);
+  va_end(args);
+}
+
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunknown-warning-option"
 
@@ -142,7 +251,11 @@ void DeepFuzzy_LogFormat(enum DeepFuzzy_LogLevel level,
 /* Override libc! */
 DEEPFUZZY_NOINLINE
 int puts(const char *str) {
-  DeepFuzzy_Log(DeepFuzzy_LogTrace, str);
+  if (DeepFuzzy_UsingSymExec) {
+    DeepFuzzy_Log(DeepFuzzy_LogTrace, str);
+  } else {
+    DeepFuzzy_LogOutputFormat(DeepFuzzy_LogTrace, "%s", str);
+  }
   return 0;
 }
 
@@ -150,7 +263,7 @@ DEEPFUZZY_NOINLINE
 int printf(const char *format, ...) {
   va_list args;
   va_start(args, format);
-  DeepFuzzy_LogVFormat(DeepFuzzy_LogTrace, format, args);
+  DeepFuzzy_LogOutput(DeepFuzzy_LogTrace, format, args);
   va_end(args);
   return 0;
 }
@@ -159,20 +272,20 @@ DEEPFUZZY_NOINLINE
 int __printf_chk(int flag, const char *format, ...) {
   va_list args;
   va_start(args, format);
-  DeepFuzzy_LogVFormat(DeepFuzzy_LogTrace, format, args);
+  DeepFuzzy_LogOutput(DeepFuzzy_LogTrace, format, args);
   va_end(args);
   return 0;
 }
 
 DEEPFUZZY_NOINLINE
 int vprintf(const char *format, va_list args) {
-  DeepFuzzy_LogVFormat(DeepFuzzy_LogTrace, format, args);
+  DeepFuzzy_LogOutput(DeepFuzzy_LogTrace, format, args);
   return 0;
 }
 
 DEEPFUZZY_NOINLINE
 int __vprintf_chk(int flag, const char *format, va_list args) {
-  DeepFuzzy_LogVFormat(DeepFuzzy_LogTrace, format, args);
+  DeepFuzzy_LogOutput(DeepFuzzy_LogTrace, format, args);
   return 0;
 }
 
@@ -181,7 +294,7 @@ int vfprintf(FILE *file, const char *format, va_list args) {
   if (stderr == file) {
     DeepFuzzy_LogVFormat(DeepFuzzy_LogDebug, format, args);
   } else if (stdout == file) {
-    DeepFuzzy_LogVFormat(DeepFuzzy_LogTrace, format, args);
+    DeepFuzzy_LogOutput(DeepFuzzy_LogTrace, format, args);
   } else {
     DeepFuzzy_LogVFormat(DeepFuzzy_LogExternal, format, args);
   }
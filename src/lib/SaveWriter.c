@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2019 KhulnaSoft DevOps, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "deepfuzzy/DeepFuzzy.h"
+#include "deepfuzzy/Option.h"
+#include "deepfuzzy/Log.h"
+#include "DeepFuzzy.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+DEEPFUZZY_BEGIN_EXTERN_C
+
+DEFINE_bool(async_save, InputOutputGroup, false, "Save passing tests from a background thread when fuzzing without forking.");
+DEFINE_bool(async_save_fsync, InputOutputGroup, false, "Sync asynchronously saved tests to disk.");
+DEFINE_uint(async_save_buffer_mb, InputOutputGroup, 64, "Memory for tests waiting to be saved asynchronously; tests beyond it are dropped.");
+
+/* Number of slots in the save queue; must be a power of two. */
+#ifndef DEEPFUZZY_SAVE_QUEUE_SIZE
+#define DEEPFUZZY_SAVE_QUEUE_SIZE 4096
+#endif
+
+/* Time the writer waits for new tests when the queue is empty. */
+#define DEEPFUZZY_SAVE_WRITER_IDLE_US 1000
+
+/* A test waiting to be saved. */
+struct DeepFuzzy_QueuedSave {
+  char name[DEEPFUZZY_TEST_NAME_LEN + 8];
+  uint8_t *data;
+  size_t size;
+};
+
+/* Single-producer, single-consumer ring of tests to save. Only the fuzzing
+ * thread advances `head`, and only the writer thread advances `tail`; each
+ * publishes the slots it is done with by a release store. */
+static struct DeepFuzzy_QueuedSave DeepFuzzy_SaveQueue[DEEPFUZZY_SAVE_QUEUE_SIZE];
+static uint32_t DeepFuzzy_SaveQueueHead = 0;
+static uint32_t DeepFuzzy_SaveQueueTail = 0;
+
+/* Bytes of test data in the queue. */
+static size_t DeepFuzzy_SaveQueueBytes = 0;
+
+static int DeepFuzzy_SaveWriterStopping = 0;
+static bool DeepFuzzy_SaveWriterRunning = false;
+
+/* Tests that were dropped because the queue was full, and tests that the
+ * writer failed to save. */
+static uint32_t DeepFuzzy_NumDroppedSaves = 0;
+static uint32_t DeepFuzzy_NumFailedSaves = 0;
+
+/* Body of the writer thread: save queued tests in batches of whatever is in
+ * the queue, until asked to stop and the queue is empty. The writer never
+ * logs, because the log streams aren't thread-safe; it only counts
+ * failures. */
+static void DeepFuzzy_SaveWriterMain(void) {
+  uint32_t tail = DeepFuzzy_SaveQueueTail;
+
+  for (;;) {
+    uint32_t head = __atomic_load_n(&DeepFuzzy_SaveQueueHead, __ATOMIC_ACQUIRE);
+    if (tail == head) {
+      if (__atomic_load_n(&DeepFuzzy_SaveWriterStopping, __ATOMIC_ACQUIRE) &&
+          tail == __atomic_load_n(&DeepFuzzy_SaveQueueHead, __ATOMIC_ACQUIRE)) {
+        break;
+      }
+      DeepFuzzy_SleepMicros(DEEPFUZZY_SAVE_WRITER_IDLE_US);
+      continue;
+    }
+
+    size_t batch_bytes = 0;
+    for (; tail != head; tail++) {
+      struct DeepFuzzy_QueuedSave *save =
+          &(DeepFuzzy_SaveQueue[tail & (DEEPFUZZY_SAVE_QUEUE_SIZE - 1)]);
+      int ret = DeepFuzzy_WriteTestFile(save->name, save->data, save->size,
+                                        FLAGS_async_save_fsync);
+      if (ret && ret != EEXIST) {
+        __atomic_fetch_add(&DeepFuzzy_NumFailedSaves, 1, __ATOMIC_RELAXED);
+      }
+      batch_bytes += save->size;
+      free(save->data);
+      save->data = NULL;
+    }
+
+    __atomic_store_n(&DeepFuzzy_SaveQueueTail, tail, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&DeepFuzzy_SaveQueueBytes, batch_bytes, __ATOMIC_RELAXED);
+  }
+}
+
+/* Start saving passing tests from a background thread, if `--async_save` is
+ * given. Saving asynchronously is only safe when tests run in this process,
+ * since forked test processes exit without waiting for the writer. */
+void DeepFuzzy_StartSaveWriter(void) {
+  if (!FLAGS_async_save || FLAGS_fork || !HAS_FLAG_output_test_dir ||
+      DeepFuzzy_SaveWriterRunning) {
+    return;
+  }
+
+  DeepFuzzy_SaveQueueHead = 0;
+  DeepFuzzy_SaveQueueTail = 0;
+  DeepFuzzy_SaveQueueBytes = 0;
+  DeepFuzzy_SaveWriterStopping = 0;
+
+  if (!DeepFuzzy_StartSaveWriterThread(DeepFuzzy_SaveWriterMain)) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogWarning,
+                        "Unable to start the save writer; saving tests synchronously");
+    return;
+  }
+  DeepFuzzy_SaveWriterRunning = true;
+
+  /* Don't lose queued tests if a failure ends fuzzing early. */
+  static bool registered = false;
+  if (!registered) {
+    atexit(DeepFuzzy_StopSaveWriter);
+    registered = true;
+  }
+}
+
+/* Queue the `size` bytes at `data` to be saved as `name`. Returns `false` if
+ * the save writer isn't running, and the caller should save the test itself.
+ * If the queue is full, or holds more than `--async_save_buffer_mb` of data,
+ * the test is dropped rather than stalling fuzzing on a slow disk. */
+bool DeepFuzzy_QueueSave(const char *name, const uint8_t *data, size_t size) {
+  if (!DeepFuzzy_SaveWriterRunning) {
+    return false;
+  }
+
+  uint32_t head = DeepFuzzy_SaveQueueHead;
+  uint32_t tail = __atomic_load_n(&DeepFuzzy_SaveQueueTail, __ATOMIC_ACQUIRE);
+  size_t budget = (size_t) FLAGS_async_save_buffer_mb << 20;
+  size_t queued_bytes = __atomic_load_n(&DeepFuzzy_SaveQueueBytes, __ATOMIC_RELAXED);
+  if (head - tail == DEEPFUZZY_SAVE_QUEUE_SIZE || queued_bytes + size > budget) {
+    DeepFuzzy_NumDroppedSaves++;
+    return true;
+  }
+
+  uint8_t *copy = (uint8_t *) malloc(size ? size : 1);
+  if (copy == NULL) {
+    DeepFuzzy_NumDroppedSaves++;
+    return true;
+  }
+  memcpy(copy, data, size);
+
+  struct DeepFuzzy_QueuedSave *save =
+      &(DeepFuzzy_SaveQueue[head & (DEEPFUZZY_SAVE_QUEUE_SIZE - 1)]);
+  memcpy(save->name, name, sizeof(save->name));
+  save->name[sizeof(save->name) - 1] = '\0';
+  save->data = copy;
+  save->size = size;
+
+  __atomic_fetch_add(&DeepFuzzy_SaveQueueBytes, size, __ATOMIC_RELAXED);
+  __atomic_store_n(&DeepFuzzy_SaveQueueHead, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/* Wait for the save writer to save all queued tests, then stop it. */
+void DeepFuzzy_StopSaveWriter(void) {
+  if (!DeepFuzzy_SaveWriterRunning) {
+    return;
+  }
+  __atomic_store_n(&DeepFuzzy_SaveWriterStopping, 1, __ATOMIC_RELEASE);
+  DeepFuzzy_JoinSaveWriterThread();
+  DeepFuzzy_SaveWriterRunning = false;
+
+  if (DeepFuzzy_NumDroppedSaves) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogWarning,
+                        "Dropped %u tests because the save queue was full",
+                        DeepFuzzy_NumDroppedSaves);
+  }
+  if (DeepFuzzy_NumFailedSaves) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogWarning,
+                        "Failed to save %u tests to `%s`",
+                        DeepFuzzy_NumFailedSaves, FLAGS_output_test_dir);
+  }
+  DeepFuzzy_NumDroppedSaves = 0;
+  DeepFuzzy_NumFailedSaves = 0;
+}
+
+DEEPFUZZY_END_EXTERN_C
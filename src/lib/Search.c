@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2019 KhulnaSoft DevOps, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "deepfuzzy/DeepFuzzy.h"
+#include "deepfuzzy/Option.h"
+#include "deepfuzzy/Log.h"
+#include "DeepFuzzy.h"
+
+#include <stdio.h>
+#include <string.h>
+
+DEEPFUZZY_BEGIN_EXTERN_C
+
+DEFINE_uint(max_search_iters, ExecutionGroup, 1 << 24, "Maximum number of values ASSIGN_SATISFYING may try in one test before abandoning it (0 for no limit).");
+
+/* Number of values tried on either side of the starting value, before trying
+ * ever larger strides away from it. */
+#define DEEPFUZZY_SEARCH_LINEAR_ITERS_LOG2 10
+#define DEEPFUZZY_SEARCH_LINEAR_ITERS (1 << DEEPFUZZY_SEARCH_LINEAR_ITERS_LOG2)
+
+/* Strides start above the values the linear search already tried. */
+#define DEEPFUZZY_SEARCH_FIRST_STRIDE_LOG2 (DEEPFUZZY_SEARCH_LINEAR_ITERS_LOG2 + 1)
+
+/* Number of consecutive values tried from each random restart. */
+#define DEEPFUZZY_SEARCH_RESTART_ITERS 16
+
+#ifndef DEEPFUZZY_MAX_SEARCH_SITES
+#define DEEPFUZZY_MAX_SEARCH_SITES 256
+#endif
+
+enum DeepFuzzy_SearchPhase {
+  DeepFuzzy_SearchLinear,
+  DeepFuzzy_SearchStride,
+  DeepFuzzy_SearchRestart,
+  DeepFuzzy_SearchProbeHigh,
+  DeepFuzzy_SearchProbeLow,
+  DeepFuzzy_SearchBisect
+};
+
+/* Number of times the searches of an `ASSIGN_SATISFYING` ran out of budget.
+ * Kept in shared memory while fuzzing, so that all fuzzer workers and forked
+ * tests count towards the same totals. */
+struct DeepFuzzy_SearchSiteStats {
+  uint64_t key;
+  uint32_t exhausted;
+  char location[DEEPFUZZY_MAX_FAIL_LOCATION];
+};
+
+static struct DeepFuzzy_SearchSiteStats *DeepFuzzy_SearchStats = NULL;
+
+/* Values left to try in the current test. */
+static uint64_t DeepFuzzy_SearchItersLeft = 0;
+
+void DeepFuzzy_ResetSearchBudget(void) {
+  DeepFuzzy_SearchItersLeft = FLAGS_max_search_iters ? FLAGS_max_search_iters : UINT64_MAX;
+}
+
+void DeepFuzzy_InitSearchStats(void) {
+  DeepFuzzy_SearchStats = (struct DeepFuzzy_SearchSiteStats *) DeepFuzzy_AllocSharedMemory(
+      DEEPFUZZY_MAX_SEARCH_SITES * sizeof(struct DeepFuzzy_SearchSiteStats));
+}
+
+void DeepFuzzy_LogSearchStats(void) {
+  if (DeepFuzzy_SearchStats == NULL) {
+    return;
+  }
+  for (unsigned i = 0; i < DEEPFUZZY_MAX_SEARCH_SITES; i++) {
+    struct DeepFuzzy_SearchSiteStats *site = &(DeepFuzzy_SearchStats[i]);
+    if (site->key && site->exhausted) {
+      DeepFuzzy_LogFormat(DeepFuzzy_LogWarning,
+                          "ASSIGN_SATISFYING at %s found no value in %u tests",
+                          site->location, site->exhausted);
+    }
+  }
+}
+
+/* Count a failed search of `search` towards the totals of its call site. */
+static void DeepFuzzy_CountFailedSearch(const struct DeepFuzzy_Search *search) {
+  if (DeepFuzzy_SearchStats == NULL) {
+    return;
+  }
+
+  uint64_t key = 0xcbf29ce484222325ULL ^ search->line;
+  for (const char *c = search->file; *c; c++) {
+    key = (key ^ (uint8_t) *c) * 0x100000001b3ULL;
+  }
+  key = key ? key : 1;
+
+  /* Linear probing; sites are only ever added, by claiming an empty slot. */
+  for (unsigned i = 0; i < DEEPFUZZY_MAX_SEARCH_SITES; i++) {
+    struct DeepFuzzy_SearchSiteStats *site =
+        &(DeepFuzzy_SearchStats[(key + i) % DEEPFUZZY_MAX_SEARCH_SITES]);
+    uint64_t found = __atomic_load_n(&site->key, __ATOMIC_ACQUIRE);
+    if (!found) {
+      uint64_t empty = 0;
+      if (__atomic_compare_exchange_n(&site->key, &empty, key, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        snprintf(site->location, sizeof(site->location), "%s(%u)",
+                 search->file, search->line);
+        found = key;
+      } else {
+        found = empty;
+      }
+    }
+    if (found == key) {
+      __atomic_fetch_add(&site->exhausted, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+}
+
+DEEPFUZZY_NORETURN
+static void DeepFuzzy_FailSearch(const struct DeepFuzzy_Search *search) {
+  DeepFuzzy_CountFailedSearch(search);
+  DeepFuzzy_LogFormat(DeepFuzzy_LogTrace,
+                      "%s(%u): ASSIGN_SATISFYING found no value after %" PRIu64 " tries",
+                      search->file, search->line, search->iters);
+  DeepFuzzy_Abandon_Due_to_Assumption("Assumption failed");
+}
+
+/* splitmix64, seeded from the starting value, so that the values tried only
+ * depend on the test's input. */
+static uint64_t DeepFuzzy_SearchRandom(struct DeepFuzzy_Search *search) {
+  uint64_t z = (search->rng += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* Set `*offset` to `base` moved by `delta` up or down, if that is still in the
+ * search's range. */
+static bool DeepFuzzy_SearchMove(const struct DeepFuzzy_Search *search,
+                                 uint64_t base, uint64_t delta, bool down,
+                                 uint64_t *offset) {
+  if (search->flags & DeepFuzzy_SearchWrap) {
+    *offset = (down ? base - delta : base + delta) & search->width;
+    return true;
+  }
+  if (down) {
+    if (delta > base) {
+      return false;
+    }
+    *offset = base - delta;
+  } else {
+    if (delta > search->width - base) {
+      return false;
+    }
+    *offset = base + delta;
+  }
+  return true;
+}
+
+/* Returns `true` if the linear search tried every value of the range. */
+static bool DeepFuzzy_SearchCoveredRange(const struct DeepFuzzy_Search *search) {
+  if (search->flags & DeepFuzzy_SearchWrap) {
+    return search->step > (search->width >> 1) + (search->width & 1);
+  }
+  return search->step > search->start &&
+         search->step > search->width - search->start;
+}
+
+/* Pick the next offset to try, moving through the phases of the search as
+ * each runs out. Returns `false` once no untried values are left. */
+static bool DeepFuzzy_NextSearchOffset(struct DeepFuzzy_Search *search,
+                                       uint64_t *offset) {
+  for (;;) {
+    switch (search->phase) {
+      /* Try the closest values first, alternating above and below the start,
+       * like the plain linear search always did. */
+      case DeepFuzzy_SearchLinear: {
+        if (DeepFuzzy_SearchCoveredRange(search)) {
+          return false;
+        }
+        if (search->step > DEEPFUZZY_SEARCH_LINEAR_ITERS) {
+          search->phase = DeepFuzzy_SearchStride;
+          search->step = DEEPFUZZY_SEARCH_FIRST_STRIDE_LOG2;
+          search->down = false;
+          continue;
+        }
+        const uint64_t step = search->step;
+        const bool down = search->down;
+        if (down) {
+          search->step++;
+        }
+        search->down = !down;
+        if (DeepFuzzy_SearchMove(search, search->start, step, down, offset)) {
+          return true;
+        }
+        continue;
+      }
+
+      /* Then exponentially growing strides, for predicates that only hold far
+       * away from the start. */
+      case DeepFuzzy_SearchStride: {
+        if (search->step >= 64 || (1ULL << search->step) > search->width) {
+          search->phase = DeepFuzzy_SearchRestart;
+          search->step = DEEPFUZZY_SEARCH_RESTART_ITERS;
+          continue;
+        }
+        const uint64_t delta = 1ULL << search->step;
+        const bool down = search->down;
+        if (down) {
+          search->step++;
+        }
+        search->down = !down;
+        if (DeepFuzzy_SearchMove(search, search->start, delta, down, offset)) {
+          return true;
+        }
+        continue;
+      }
+
+      /* Finally, runs of values from random points of the range. */
+      case DeepFuzzy_SearchRestart: {
+        if (search->step == DEEPFUZZY_SEARCH_RESTART_ITERS) {
+          uint64_t r = DeepFuzzy_SearchRandom(search);
+          search->restart = (search->width == UINT64_MAX) ? r : r % (search->width + 1);
+          search->step = 0;
+        }
+        if (DeepFuzzy_SearchMove(search, search->restart, search->step++, false, offset)) {
+          return true;
+        }
+        search->step = DEEPFUZZY_SEARCH_RESTART_ITERS;
+        continue;
+      }
+
+      default:
+        return false;
+    }
+  }
+}
+
+/* Set the current value of the search to `offset` in its range, counting it
+ * against the search's and the test's budgets. */
+static void DeepFuzzy_TrySearchOffset(struct DeepFuzzy_Search *search,
+                                      uint64_t offset) {
+  if (search->iters >= search->max_iters || !DeepFuzzy_SearchItersLeft) {
+    DeepFuzzy_FailSearch(search);
+  }
+  search->iters++;
+  DeepFuzzy_SearchItersLeft--;
+  search->value = search->low + offset;
+}
+
+/* Bisect between the offsets `search->below`, where the predicate is false,
+ * and `search->above`, where it is true. */
+static int DeepFuzzy_BisectSearch(struct DeepFuzzy_Search *search) {
+  const uint64_t false_at = search->below;
+  const uint64_t true_at = search->above;
+  const uint64_t gap = (true_at > false_at) ? true_at - false_at : false_at - true_at;
+  if (gap <= 1) {
+    search->value = search->low + true_at;
+    return 0;
+  }
+  DeepFuzzy_TrySearchOffset(search, (true_at > false_at) ? false_at + gap / 2
+                                                          : false_at - gap / 2);
+  return 1;
+}
+
+void DeepFuzzy_BeginSearch(struct DeepFuzzy_Search *search, const char *file,
+                           unsigned line, uint64_t low, uint64_t width,
+                           uint64_t start, unsigned flags, uint64_t max_iters) {
+  memset(search, 0, sizeof(*search));
+  search->file = file;
+  search->line = line;
+  search->flags = flags;
+  search->low = low;
+  search->width = width;
+  search->start = start;
+  search->max_iters = max_iters;
+  search->rng = start ^ ((uint64_t) line << 32);
+
+  if (flags & DeepFuzzy_SearchMonotone) {
+    /* The predicate holds on one side of some value, and the start is on the
+     * other side; see which end it holds at. */
+    if (search->start < width) {
+      search->phase = DeepFuzzy_SearchProbeHigh;
+      DeepFuzzy_TrySearchOffset(search, width);
+    } else if (search->start > 0) {
+      search->phase = DeepFuzzy_SearchProbeLow;
+      DeepFuzzy_TrySearchOffset(search, 0);
+    } else {
+      DeepFuzzy_FailSearch(search);
+    }
+    return;
+  }
+
+  search->phase = DeepFuzzy_SearchLinear;
+  search->step = 1;
+  uint64_t offset;
+  if (!DeepFuzzy_NextSearchOffset(search, &offset)) {
+    DeepFuzzy_FailSearch(search);
+  }
+  DeepFuzzy_TrySearchOffset(search, offset);
+}
+
+int DeepFuzzy_SearchNext(struct DeepFuzzy_Search *search, int satisfied) {
+  switch (search->phase) {
+    case DeepFuzzy_SearchProbeHigh:
+      if (satisfied) {
+        search->phase = DeepFuzzy_SearchBisect;
+        search->below = search->start;
+        search->above = search->width;
+        return DeepFuzzy_BisectSearch(search);
+      }
+      if (search->start == 0) {
+        DeepFuzzy_FailSearch(search);
+      }
+      search->phase = DeepFuzzy_SearchProbeLow;
+      DeepFuzzy_TrySearchOffset(search, 0);
+      return 1;
+
+    case DeepFuzzy_SearchProbeLow:
+      if (!satisfied) {
+        DeepFuzzy_FailSearch(search);
+      }
+      search->phase = DeepFuzzy_SearchBisect;
+      search->below = search->start;
+      search->above = 0;
+      return DeepFuzzy_BisectSearch(search);
+
+    case DeepFuzzy_SearchBisect:
+      if (satisfied) {
+        search->above = search->value - search->low;
+      } else {
+        search->below = search->value - search->low;
+      }
+      return DeepFuzzy_BisectSearch(search);
+
+    default: {
+      if (satisfied) {
+        return 0;
+      }
+      uint64_t offset;
+      if (!DeepFuzzy_NextSearchOffset(search, &offset)) {
+        DeepFuzzy_FailSearch(search);
+      }
+      DeepFuzzy_TrySearchOffset(search, offset);
+      return 1;
+    }
+  }
+}
+
+DEEPFUZZY_END_EXTERN_C
@@ -23,13 +23,18 @@
 #include <inttypes.h>
 
 #include "deepfuzzy/DeepFuzzy.h"
+#include "deepfuzzy/Option.h"
 #include "deepfuzzy/Log.h"
 
 DEEPFUZZY_BEGIN_EXTERN_C
 
-enum {
-  DeepFuzzy_StreamSize = 1048576
-};
+DEFINE_uint(max_stream_size, ExecutionGroup, 1048576, "Maximum number of bytes in one log message; tests that log longer messages are abandoned.");
+
+/* Streams, and the format string being streamed, start out in a buffer of
+ * this size, and move to the heap if they outgrow it. */
+#ifndef DEEPFUZZY_STREAM_INLINE_SIZE
+#define DEEPFUZZY_STREAM_INLINE_SIZE 256
+#endif
 
 /* Formatting options available to the streaming API. */
 struct DeepFuzzy_StreamFormatOptions {
@@ -49,8 +54,10 @@ struct DeepFuzzy_StreamFormatOptions {
  * `ASSERT` and `CHECK` macros is really nice. */
 struct DeepFuzzy_Stream {
   int size;
+  int capacity;
+  char *message;
   struct DeepFuzzy_StreamFormatOptions options;
-  char message[DeepFuzzy_StreamSize + 2];
+  char inline_message[DEEPFUZZY_STREAM_INLINE_SIZE];
   char staging[32];
   char format[32];
   char unpack[32];
@@ -142,14 +149,139 @@ static void DeepFuzzy_StreamIntFormat(struct DeepFuzzy_Stream *stream,
   format[i++] = '\0';
 }
 
-/* Make sure that we don't exceed our formatting capacity when running. */
-static void CheckCapacity(struct DeepFuzzy_Stream *stream,
-                          int num_chars_to_add) {
+/* Grow the heap buffer `*buf`, which is `*capacity` bytes, or starts out as
+ * `inline_buf` if that's smaller, to hold at least `min_capacity` bytes. */
+static void DeepFuzzy_GrowBuffer(char **buf, int *capacity, char *inline_buf,
+                                 int min_capacity) {
+  int new_capacity = *capacity;
+  while (new_capacity < min_capacity) {
+    new_capacity = (new_capacity > (INT32_MAX / 2)) ? min_capacity : new_capacity * 2;
+  }
+  if ((uint32_t) new_capacity > FLAGS_max_stream_size + 1) {
+    new_capacity = (int) FLAGS_max_stream_size + 1;
+  }
+
+  char *new_buf = NULL;
+  if (*buf == inline_buf) {
+    new_buf = (char *) malloc((size_t) new_capacity);
+    if (new_buf) {
+      memcpy(new_buf, inline_buf, (size_t) *capacity);
+    }
+  } else {
+    new_buf = (char *) realloc(*buf, (size_t) new_capacity);
+  }
+  if (!new_buf) {
+    DeepFuzzy_Abandon("Can't allocate memory for stream buffer.");
+  }
+  *buf = new_buf;
+  *capacity = new_capacity;
+}
+
+/* Streams use their inline buffer until they first outgrow it. */
+static void DeepFuzzy_StreamInitBuffer(struct DeepFuzzy_Stream *stream) {
+  if (!stream->message) {
+    stream->message = stream->inline_message;
+    stream->capacity = DEEPFUZZY_STREAM_INLINE_SIZE;
+  }
+}
+
+/* Return the end of the stream's message, where new output goes. */
+static char *DeepFuzzy_StreamEnd(struct DeepFuzzy_Stream *stream) {
+  DeepFuzzy_StreamInitBuffer(stream);
+  return &(stream->message[stream->size]);
+}
+
+/* Return the number of bytes, including a terminating NUL, that fit at the
+ * end of the stream's message. */
+static int DeepFuzzy_StreamRoom(struct DeepFuzzy_Stream *stream) {
+  DeepFuzzy_StreamInitBuffer(stream);
+  return stream->capacity - stream->size;
+}
+
+/* Make sure that we don't exceed our formatting capacity when running. If
+ * `num_chars_to_add` didn't fit at the end of the stream's message, then the
+ * message is grown, and `1` is returned so that the caller writes them again. */
+static int CheckCapacity(struct DeepFuzzy_Stream *stream,
+                         int num_chars_to_add) {
   if (0 > num_chars_to_add) {
     DeepFuzzy_Abandon("Can't add a negative number of characters to a stream.");
-  } else if ((stream->size + num_chars_to_add) >= DeepFuzzy_StreamSize) {
+  } else if ((uint32_t) (stream->size + num_chars_to_add) >= FLAGS_max_stream_size) {
     DeepFuzzy_Abandon("Exceeded capacity of stream buffer.");
+  } else if (num_chars_to_add >= DeepFuzzy_StreamRoom(stream)) {
+    DeepFuzzy_GrowBuffer(&(stream->message), &(stream->capacity),
+                         stream->inline_message,
+                         stream->size + num_chars_to_add + 1);
+    return 1;
   }
+  return 0;
+}
+
+/* Two-digit strings of the numbers 0 to 99, to print integers two digits at
+ * a time. */
+static const char DeepFuzzy_DigitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Print `val` like `snprintf(out, size, format, val)` does, if `format` is a
+ * plain decimal conversion such as `%d` or `%llu`, without flags, width or
+ * precision. `is_64` says whether `val` is passed as 64 bits, as opposed to
+ * 32. Returns the number of characters of the output, or `-1` if `format`
+ * isn't handled here. */
+static int DeepFuzzy_FormatDecimal(char *out, int size, const char *format,
+                                   uint64_t val, int is_64) {
+  int bits = 32;
+  const char *p = &(format[1]);
+  if ('h' == *p) {
+    bits = ('h' == p[1]) ? 8 : 16;
+    p += (bits == 8) ? 2 : 1;
+  } else if ('l' == *p) {
+    bits = ('l' == p[1]) ? 64 : (int) (sizeof(long) * 8);
+    p += ('l' == p[1]) ? 2 : 1;
+  } else if ('j' == *p || 'z' == *p || 't' == *p) {
+    bits = 64;
+    p += 1;
+  }
+  const int is_signed = ('d' == *p || 'i' == *p);
+  if ((!is_signed && 'u' != *p) || p[1] || bits > (is_64 ? 64 : 32)) {
+    return -1;
+  }
+
+  /* Narrow the value like `printf` would. */
+  if (bits < 64) {
+    val &= (1ULL << bits) - 1;
+    if (is_signed && (val >> (bits - 1))) {
+      val |= ~0ULL << bits;
+    }
+  }
+  const int negative = is_signed && (int64_t) val < 0;
+  uint64_t mag = negative ? (0 - val) : val;
+
+  char digits[24];
+  char *end = &(digits[sizeof(digits)]);
+  char *begin = end;
+  while (mag >= 100) {
+    const unsigned pair = (unsigned) (mag % 100) * 2;
+    mag /= 100;
+    *--begin = DeepFuzzy_DigitPairs[pair + 1];
+    *--begin = DeepFuzzy_DigitPairs[pair];
+  }
+  if (mag >= 10) {
+    *--begin = DeepFuzzy_DigitPairs[mag * 2 + 1];
+    *--begin = DeepFuzzy_DigitPairs[mag * 2];
+  } else {
+    *--begin = (char) ('0' + mag);
+  }
+  if (negative) {
+    *--begin = '-';
+  }
+
+  const int len = (int) (end - begin);
+  if (len < size) {
+    memcpy(out, begin, (size_t) len);
+    out[len] = '\0';
+  }
+  return len;
 }
 
 /* Stream an integer into the stream's message. This function is designed to
@@ -161,15 +293,21 @@ void _DeepFuzzy_StreamInt(enum DeepFuzzy_LogLevel level, const char *format,
                        const char *unpack, uint64_t *val) {
   struct DeepFuzzy_Stream *stream = &(DeepFuzzy_Streams[level]);
   int size = 0;
-  int remaining_size = DeepFuzzy_StreamSize - stream->size;
-  if (unpack[1] == 'Q' || unpack[1] == 'q') {
-    size = snprintf(&(stream->message[stream->size]),
-                    remaining_size, format, *val);
-  } else {
-    size = snprintf(&(stream->message[stream->size]),
-                    remaining_size, format, (uint32_t) *val);
-  }
-  CheckCapacity(stream, size);
+  const int is_64 = (unpack[1] == 'Q' || unpack[1] == 'q');
+  do {
+    size = DeepFuzzy_FormatDecimal(DeepFuzzy_StreamEnd(stream),
+                                   DeepFuzzy_StreamRoom(stream), format,
+                                   *val, is_64);
+    if (size >= 0) {
+      /* Printed without `snprintf`. */
+    } else if (is_64) {
+      size = snprintf(DeepFuzzy_StreamEnd(stream), DeepFuzzy_StreamRoom(stream),
+                      format, *val);
+    } else {
+      size = snprintf(DeepFuzzy_StreamEnd(stream), DeepFuzzy_StreamRoom(stream),
+                      format, (uint32_t) *val);
+    }
+  } while (CheckCapacity(stream, size));
   stream->size += size;
 }
 
@@ -178,10 +316,11 @@ DEEPFUZZY_NOINLINE
 void _DeepFuzzy_StreamFloat(enum DeepFuzzy_LogLevel level, const char *format,
                          const char *unpack, double *val) {
   struct DeepFuzzy_Stream *stream = &(DeepFuzzy_Streams[level]);
-  int remaining_size = DeepFuzzy_StreamSize - stream->size;
-  int size = snprintf(&(stream->message[stream->size]),
-                      remaining_size, format, *val);
-  CheckCapacity(stream, size);
+  int size = 0;
+  do {
+    size = snprintf(DeepFuzzy_StreamEnd(stream), DeepFuzzy_StreamRoom(stream),
+                    format, *val);
+  } while (CheckCapacity(stream, size));
   stream->size += size;
 }
 
@@ -190,10 +329,20 @@ DEEPFUZZY_NOINLINE
 void _DeepFuzzy_StreamString(enum DeepFuzzy_LogLevel level, const char *format,
                           const char *str) {
   struct DeepFuzzy_Stream *stream = &(DeepFuzzy_Streams[level]);
-  int remaining_size = DeepFuzzy_StreamSize - stream->size;
-  int size = snprintf(&(stream->message[stream->size]),
-                      remaining_size, format, str);
-  CheckCapacity(stream, size);
+  int size = 0;
+  const int plain = str && !strcmp(format, "%s");
+  do {
+    if (plain) {
+      /* Copy the string as is, e.g. the text around conversions. */
+      size = (int) strlen(str);
+      if (size < DeepFuzzy_StreamRoom(stream)) {
+        memcpy(DeepFuzzy_StreamEnd(stream), str, (size_t) size + 1);
+      }
+    } else {
+      size = snprintf(DeepFuzzy_StreamEnd(stream), DeepFuzzy_StreamRoom(stream),
+                      format, str);
+    }
+  } while (CheckCapacity(stream, size));
   stream->size += size;
 }
 
@@ -285,7 +434,6 @@ void DeepFuzzy_LogStream(enum DeepFuzzy_LogLevel level) {
   struct DeepFuzzy_Stream *stream = &(DeepFuzzy_Streams[level]);
   if (stream->size) {
     stream->message[stream->size] = '\0';
-    stream->message[DeepFuzzy_StreamSize] = '\0';
     DeepFuzzy_Log(level, stream->message);
     DeepFuzzy_ClearStream(level);
   }
@@ -297,6 +445,14 @@ void DeepFuzzy_StreamResetFormatting(enum DeepFuzzy_LogLevel level) {
   DeepFuzzy_MemScrub(&(stream->options), sizeof(stream->options));
 }
 
+/* Clear the contents and reset the formatting of all streams. */
+void DeepFuzzy_ResetStreams(void) {
+  for (int level = 0; level <= DeepFuzzy_LogFatal; level++) {
+    DeepFuzzy_ClearStream((enum DeepFuzzy_LogLevel) level);
+    DeepFuzzy_StreamResetFormatting((enum DeepFuzzy_LogLevel) level);
+  }
+}
+
 static int DeepFuzzy_NumLsInt64BitFormat = 2;
 
 /* `PRId64` will be "ld" or "lld" */
@@ -304,27 +460,41 @@ DEEPFUZZY_INITIALIZER(DeepFuzzy_NumLsFor64BitFormat) {
   DeepFuzzy_NumLsInt64BitFormat = (PRId64)[1] == 'd' ? 1 : 2;
 }
 
-/* Approximately do string format parsing and convert it into calls into our
- * streaming API. */
+/* A parsed conversion of a format string, e.g. `%08llx`. */
+struct DeepFuzzy_FormatSpec {
+  /* The conversion, as passed on to `snprintf`. */
+  char format[32];
+
+  /* The kind of argument it converts: `c`, `d` (signed), `u` (unsigned), `f`,
+   * `s`, or `n` for none. */
+  char kind;
+
+  /* Size in bytes of integer arguments, and `struct.unpack` type of them. */
+  char length;
+  char extract;
+
+  char long_double;
+};
+
+/* Approximately do string format parsing of the conversion at `format` into
+ * `spec`. Returns the number of characters of `format` that it spans. */
 DEEPFUZZY_NOINLINE
-static int DeepFuzzy_StreamFormatValue(enum DeepFuzzy_LogLevel level,
-                                       const char *format,
-                                       struct DeepFuzzy_VarArgs *va) {
-  struct DeepFuzzy_Stream *stream = &(DeepFuzzy_Streams[level]);
-  char format_buf[32] = {'\0'};
+static int DeepFuzzy_ParseFormatSpec(const char *format,
+                                     struct DeepFuzzy_FormatSpec *spec) {
+  char *format_buf = spec->format;
   int i = 0;
   int k = 0;
   int length = 4;
   char ch = '\0';
-  int is_string = 0;
-  int is_unsigned = 0;
-  int is_float = 0;
-  int long_double = 0;
   int num_ls = 0;
-  char extract = '\0';
+
+  memset(spec, 0, sizeof(*spec));
 
 #define READ_FORMAT_CHAR \
   ch = format[i]; \
+  if ((i - k + 1) >= (int) sizeof(spec->format)) { \
+    DeepFuzzy_Abandon("Format specifier is too long."); \
+  } \
   format_buf[i - k] = ch; \
   format_buf[i - k + 1] = '\0'; \
   i++
@@ -412,7 +582,7 @@ get_length_char:
       DeepFuzzy_Abandon("Incomplete format (length).");
       return 0;
     case 'L':
-      long_double = 1;
+      spec->long_double = 1;
       k += 1;  /* Overwrite the `L`. */
       READ_FORMAT_CHAR;
       break;
@@ -440,14 +610,14 @@ get_length_char:
       break;
   }
 
+#undef READ_FORMAT_CHAR
+
   if (!length) {
     length = 1;
   } else if (num_ls >= DeepFuzzy_NumLsInt64BitFormat) {
     length = 8;
   }
 
-  format_buf[i] = '\0';
-
   /* Specifier */
   switch(ch) {
     case '\0':
@@ -455,33 +625,20 @@ get_length_char:
       return 0;
 
     case 'n':
-      return i;  /* Nothing printed. */
+      spec->kind = 'n';  /* Nothing printed. */
+      return i;
 
     /* Print a character. */
     case 'c':
-      stream->value.as_uint64 = (uint64_t) (char) va_arg(va->args, int);
-      extract = 'c';
-      goto common_stream_int;
+      spec->kind = 'c';
+      spec->extract = 'c';
+      return i;
 
     /* Signed integer. */
     case 'd':
     case 'i':
-      if (1 == length) {
-        stream->value.as_uint64 = (uint64_t) (int8_t) va_arg(va->args, int);
-        extract = 'b';
-      } else if (2 == length) {
-        stream->value.as_uint64 = (uint64_t) (int16_t) va_arg(va->args, int);
-        extract = 'h';
-      } else if (4 == length) {
-        stream->value.as_uint64 = (uint64_t) (int32_t) va_arg(va->args, int);
-        extract = 'i';
-      } else if (8 == length) {
-        stream->value.as_uint64 = (uint64_t) va_arg(va->args, int64_t);
-        extract = 'q';
-      } else {
-        DeepFuzzy_Abandon("Unsupported integer length.");
-      }
-      goto common_stream_int;
+      spec->kind = 'd';
+      break;
 
     /* Pointer. */
     case 'p':
@@ -494,27 +651,8 @@ get_length_char:
     case 'o':
     case 'x':
     case 'X':
-      if (1 == length) {
-        stream->value.as_uint64 = (uint64_t) (uint8_t) va_arg(va->args, int);
-        extract = 'B';
-      } else if (2 == length) {
-        stream->value.as_uint64 = (uint64_t) (uint16_t) va_arg(va->args, int);
-        extract = 'H';
-      } else if (4 == length) {
-        stream->value.as_uint64 = (uint64_t) (uint32_t) va_arg(va->args, int);
-        extract = 'I';
-      } else if (8 == length) {
-        stream->value.as_uint64 = (uint64_t) va_arg(va->args, uint64_t);
-        extract = 'Q';
-      } else {
-        DeepFuzzy_Abandon("Unsupported integer length.");
-      }
-
-    common_stream_int:
-      DeepFuzzy_StreamUnpack(stream, extract);
-      _DeepFuzzy_StreamInt(level, format_buf, stream->unpack,
-                           &(stream->value.as_uint64));
-      goto done;
+      spec->kind = 'u';
+      break;
 
     /* Floating point, scientific notation, etc. */
     case 'f':
@@ -525,98 +663,261 @@ get_length_char:
     case 'G':
     case 'a':
     case 'A':
-      if (long_double) {
+      spec->kind = 'f';
+      return i;
+
+    case 's':
+      spec->kind = 's';
+      return i;
+
+    default:
+      DeepFuzzy_Abandon("Unsupported format specifier.");
+      return 0;
+  }
+
+  switch (length) {
+    case 1: spec->extract = 'b'; break;
+    case 2: spec->extract = 'h'; break;
+    case 4: spec->extract = 'i'; break;
+    case 8: spec->extract = 'q'; break;
+    default:
+      DeepFuzzy_Abandon("Unsupported integer length.");
+      return 0;
+  }
+  if (spec->kind == 'u') {
+    spec->extract = (char) (spec->extract - 'a' + 'A');  /* Unsigned types. */
+  }
+  spec->length = (char) length;
+  return i;
+}
+
+/* Stream the next argument in `va` with the conversion `spec`. */
+static void DeepFuzzy_StreamFormatSpec(enum DeepFuzzy_LogLevel level,
+                                       const struct DeepFuzzy_FormatSpec *spec,
+                                       struct DeepFuzzy_VarArgs *va) {
+  struct DeepFuzzy_Stream *stream = &(DeepFuzzy_Streams[level]);
+  switch (spec->kind) {
+    case 'c':
+      stream->value.as_uint64 = (uint64_t) (char) va_arg(va->args, int);
+      break;
+
+    case 'd':
+      if (1 == spec->length) {
+        stream->value.as_uint64 = (uint64_t) (int8_t) va_arg(va->args, int);
+      } else if (2 == spec->length) {
+        stream->value.as_uint64 = (uint64_t) (int16_t) va_arg(va->args, int);
+      } else if (4 == spec->length) {
+        stream->value.as_uint64 = (uint64_t) (int32_t) va_arg(va->args, int);
+      } else {
+        stream->value.as_uint64 = (uint64_t) va_arg(va->args, int64_t);
+      }
+      break;
+
+    case 'u':
+      if (1 == spec->length) {
+        stream->value.as_uint64 = (uint64_t) (uint8_t) va_arg(va->args, int);
+      } else if (2 == spec->length) {
+        stream->value.as_uint64 = (uint64_t) (uint16_t) va_arg(va->args, int);
+      } else if (4 == spec->length) {
+        stream->value.as_uint64 = (uint64_t) (uint32_t) va_arg(va->args, int);
+      } else {
+        stream->value.as_uint64 = (uint64_t) va_arg(va->args, uint64_t);
+      }
+      break;
+
+    case 'f':
+      if (spec->long_double) {
         stream->value.as_fp64 = (double) va_arg(va->args, long double);
       } else {
         stream->value.as_fp64 = va_arg(va->args, double);
       }
       DeepFuzzy_StreamUnpack(stream, 'd');
-      _DeepFuzzy_StreamFloat(level, format_buf, stream->unpack,
+      _DeepFuzzy_StreamFloat(level, spec->format, stream->unpack,
                              &(stream->value.as_fp64));
-      goto done;
+      return;
 
     case 's': {
       const char *str = va_arg(va->args, const char *);
-      _DeepFuzzy_StreamString(level, format_buf, str);
-      goto done;
+      _DeepFuzzy_StreamString(level, spec->format, str);
+      return;
     }
 
     default:
-      DeepFuzzy_Abandon("Unsupported format specifier.");
-      return 0;
+      return;  /* `%n` */
+  }
+
+  DeepFuzzy_StreamUnpack(stream, spec->extract);
+  _DeepFuzzy_StreamInt(level, spec->format, stream->unpack,
+                       &(stream->value.as_uint64));
+}
+
+/* One piece of a format string: either literal text, or a conversion. */
+struct DeepFuzzy_FormatSegment {
+  const char *text;
+  struct DeepFuzzy_FormatSpec spec;
+};
+
+/* A format string split into its literal text and parsed conversions. */
+struct DeepFuzzy_CompiledFormat {
+  /* Address of the format string this was compiled from, and a copy of it to
+   * check that the same address still holds the same format. */
+  const char *key;
+  char *format;
+  int format_capacity;
+
+  /* The literal pieces of the format, each NUL-terminated. */
+  char *text;
+  int text_capacity;
+
+  struct DeepFuzzy_FormatSegment *segments;
+  int num_segments;
+  int max_segments;
+};
+
+#ifndef DEEPFUZZY_FORMAT_CACHE_SIZE
+#define DEEPFUZZY_FORMAT_CACHE_SIZE 64
+#endif
+
+/* Compiled format strings of concrete runs, indexed by a hash of their
+ * address. Formats are nearly always string literals, so the same few
+ * addresses come back on every call. */
+static struct DeepFuzzy_CompiledFormat
+    DeepFuzzy_FormatCache[DEEPFUZZY_FORMAT_CACHE_SIZE] = {};
+
+/* Format being streamed under symbolic execution, where it may not be safe to
+ * keep the format around. */
+static struct DeepFuzzy_CompiledFormat DeepFuzzy_SymbolicFormat = {};
+
+/* Holding buffer for a format string under symbolic execution, so that it can
+ * be concretized before it is compiled. */
+static char DeepFuzzy_InlineFormat[DEEPFUZZY_STREAM_INLINE_SIZE];
+static char *DeepFuzzy_Format = DeepFuzzy_InlineFormat;
+static int DeepFuzzy_FormatCapacity = DEEPFUZZY_STREAM_INLINE_SIZE;
+
+/* Make sure `*buf` holds at least `size` bytes. */
+static void DeepFuzzy_ReserveBuffer(void **buf, int *capacity, size_t elem_size,
+                                    int size) {
+  if (size <= *capacity) {
+    return;
   }
-done:
-  if (!i) {
-    DeepFuzzy_Abandon("Made no progress.");
+  int new_capacity = *capacity ? *capacity : 16;
+  while (new_capacity < size) {
+    new_capacity *= 2;
   }
-  return i;
+  void *new_buf = realloc(*buf, (size_t) new_capacity * elem_size);
+  if (!new_buf) {
+    DeepFuzzy_Abandon("Can't allocate memory for format string.");
+  }
+  *buf = new_buf;
+  *capacity = new_capacity;
 }
 
-/* Holding buffer for a format string. If we have something like `foo%dbar`
- * then we want to be able to pull out the `%d`, and so having the format
- * string in a mutable buffer lets us conveniently NUL-out the `b` of `bar`
- * following the `%d`. */
-static char DeepFuzzy_Format[DeepFuzzy_StreamSize + 1];
+/* Split the `len`-byte format string `format` into `compiled`. */
+static void DeepFuzzy_CompileFormat(struct DeepFuzzy_CompiledFormat *compiled,
+                                    const char *format, int len) {
+  DeepFuzzy_ReserveBuffer((void **) &(compiled->format),
+                          &(compiled->format_capacity), 1, len + 1);
+  memcpy(compiled->format, format, (size_t) len + 1);
 
-/* Stream some formatted input. This converts a `printf`-style format string
- * into a */
-void DeepFuzzy_StreamVFormat(enum DeepFuzzy_LogLevel level,
-                             const char *format_, va_list args) {
-  struct DeepFuzzy_VarArgs va;
-  va_copy(va.args, args);
+  /* Every literal piece is followed by a conversion, except maybe the last,
+   * so the pieces and their NULs take at most twice the format's length. */
+  DeepFuzzy_ReserveBuffer((void **) &(compiled->text),
+                          &(compiled->text_capacity), 1, 2 * len + 2);
+  compiled->num_segments = 0;
 
+  char *text = compiled->text;
   char *begin = NULL;
-  char *end = NULL;
-  char *format = &(DeepFuzzy_Format[0]);
   int i = 0;
-  char ch = '\0';
-  char next_ch = '\0';
-  size_t len = strlen(format_);
 
-  if (len >= DeepFuzzy_StreamSize) {
-    DeepFuzzy_Abandon("Format string is too long.");
+  while (i < len) {
+    if ('%' == format[i] && '%' != format[i + 1]) {
+      if (begin) {
+        *text++ = '\0';
+        begin = NULL;
+      }
+      DeepFuzzy_ReserveBuffer((void **) &(compiled->segments),
+                              &(compiled->max_segments),
+                              sizeof(struct DeepFuzzy_FormatSegment),
+                              compiled->num_segments + 1);
+      struct DeepFuzzy_FormatSegment *segment =
+          &(compiled->segments[compiled->num_segments++]);
+      segment->text = NULL;
+      const int consumed = DeepFuzzy_ParseFormatSpec(&(format[i]), &(segment->spec));
+      if (!consumed) {
+        DeepFuzzy_Abandon("Made no progress.");
+      }
+      i += consumed;
+      continue;
+    }
+
+    if (!begin) {
+      DeepFuzzy_ReserveBuffer((void **) &(compiled->segments),
+                              &(compiled->max_segments),
+                              sizeof(struct DeepFuzzy_FormatSegment),
+                              compiled->num_segments + 1);
+      begin = text;
+      compiled->segments[compiled->num_segments++].text = begin;
+    }
+    *text++ = format[i];
+    i += ('%' == format[i]) ? 2 : 1;  /* `%%` prints one `%`. */
+  }
+  if (begin) {
+    *text = '\0';
   }
+}
+
+/* Stream some formatted input. This converts a `printf`-style format string
+ * into calls into our streaming API. */
+void DeepFuzzy_StreamVFormat(enum DeepFuzzy_LogLevel level,
+                             const char *format_, va_list args) {
+  struct DeepFuzzy_VarArgs va;
+  va_copy(va.args, args);
 
-  /* Concretize the string format. */
-  memcpy(format, format_, len);
-  format[len] = '\0';
-  DeepFuzzy_ConcretizeCStr(format);
+  struct DeepFuzzy_CompiledFormat *compiled = NULL;
 
-  for (i = 0; '\0' != (ch = format[i]); ) {
-    if (!begin) {
-      begin = &(format[i]);
+  if (DeepFuzzy_UsingSymExec) {
+    size_t len = strlen(format_);
+    if (len >= FLAGS_max_stream_size) {
+      DeepFuzzy_Abandon("Format string is too long.");
+    } else if (len >= (size_t) DeepFuzzy_FormatCapacity) {
+      DeepFuzzy_GrowBuffer(&DeepFuzzy_Format, &DeepFuzzy_FormatCapacity,
+                           DeepFuzzy_InlineFormat, (int) len + 1);
     }
 
-    if ('%' == ch) {
-      if ('%' == format[i + 1]) {
-        end = &(format[i]);
-        next_ch = end[1];
-        end[1] = '\0';
-        DeepFuzzy_StreamCStr(level, begin);
-        end[1] = next_ch;
-        begin = NULL;
-        end = NULL;
-        i += 2;
+    /* Concretize the string format. */
+    memcpy(DeepFuzzy_Format, format_, len);
+    DeepFuzzy_Format[len] = '\0';
+    DeepFuzzy_ConcretizeCStr(DeepFuzzy_Format);
 
-      } else {
-        if (end) {
-          next_ch = end[1];
-          end[1] = '\0';
-          DeepFuzzy_StreamCStr(level, begin);
-          end[1] = next_ch;
-        }
-        begin = NULL;
-        end = NULL;
-        i += DeepFuzzy_StreamFormatValue(level, &(format[i]), &va);
+    compiled = &DeepFuzzy_SymbolicFormat;
+    DeepFuzzy_CompileFormat(compiled, DeepFuzzy_Format, (int) len);
+
+  } else {
+    const uintptr_t addr = (uintptr_t) format_;
+    compiled = &(DeepFuzzy_FormatCache[
+        ((addr >> 3) ^ (addr >> 11)) % DEEPFUZZY_FORMAT_CACHE_SIZE]);
+
+    if (compiled->key != format_ || strcmp(compiled->format, format_)) {
+      size_t len = strlen(format_);
+      if (len >= FLAGS_max_stream_size) {
+        DeepFuzzy_Abandon("Format string is too long.");
       }
-    } else {
-      end = &(format[i]);
-      i += 1;
+
+      /* Only cache the format once it's compiled, in case compiling it
+       * abandons the test. */
+      compiled->key = NULL;
+      DeepFuzzy_CompileFormat(compiled, format_, (int) len);
+      compiled->key = format_;
     }
   }
 
-  if (begin && begin[0]) {
-    DeepFuzzy_StreamCStr(level, begin);
+  for (int i = 0; i < compiled->num_segments; i++) {
+    const struct DeepFuzzy_FormatSegment *segment = &(compiled->segments[i]);
+    if (segment->text) {
+      DeepFuzzy_StreamCStr(level, segment->text);
+    } else {
+      DeepFuzzy_StreamFormatSpec(level, &(segment->spec), &va);
+    }
   }
 }
 
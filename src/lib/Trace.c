@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2019 KhulnaSoft DevOps, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "deepfuzzy/DeepFuzzy.h"
+#include "deepfuzzy/Option.h"
+#include "deepfuzzy/Log.h"
+#include "DeepFuzzy.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+DEEPFUZZY_BEGIN_EXTERN_C
+
+DEFINE_string(trace_reads, InputOutputGroup, "", "File to write a binary trace of the input read by tests to, or the number of a file descriptor to write it to.");
+
+int DeepFuzzy_TraceReads = 0;
+
+static FILE *DeepFuzzy_TraceFile = NULL;
+
+/* Site of the last record, for records that share it. */
+static uint64_t DeepFuzzy_TraceLastSite = 0;
+
+bool DeepFuzzy_OpenTrace(void) {
+  if (DeepFuzzy_TraceFile != NULL) {
+    return true;
+  }
+  const char *name = FLAGS_trace_reads;
+  if (name == NULL || !name[0]) {
+    return false;
+  }
+
+  if (strspn(name, "0123456789") == strlen(name)) {
+    DeepFuzzy_TraceFile = fdopen(atoi(name), "wb");
+  } else {
+    DeepFuzzy_TraceFile = fopen(name, "wb");
+  }
+  if (DeepFuzzy_TraceFile == NULL) {
+    DeepFuzzy_LogFormat(DeepFuzzy_LogError, "Unable to open trace `%s`", name);
+    exit(1);
+  }
+
+  /* Records are written right away, so that the trace of a test that crashes
+   * is complete, and forked tests don't repeat buffered records. */
+  setvbuf(DeepFuzzy_TraceFile, NULL, _IONBF, 0);
+  return true;
+}
+
+static void DeepFuzzy_WriteTraceRecord(enum DeepFuzzy_TraceKind kind,
+                                       uint32_t offset, uint32_t width,
+                                       int64_t value, uint64_t site,
+                                       unsigned num_bits) {
+  if (DeepFuzzy_TraceFile == NULL) {
+    return;
+  }
+  struct DeepFuzzy_TraceRecord record;
+  memset(&record, 0, sizeof(record));
+  record.offset = offset;
+  record.width = width;
+  record.site = site ? site : DeepFuzzy_TraceLastSite;
+  record.value = value;
+  record.kind = (uint8_t) kind;
+  record.bits = (uint8_t) num_bits;
+  DeepFuzzy_TraceLastSite = record.site;
+  fwrite(&record, sizeof(record), 1, DeepFuzzy_TraceFile);
+}
+
+void DeepFuzzy_TraceRead(enum DeepFuzzy_TraceKind kind, uint32_t offset,
+                         uint32_t width, int64_t value, uint64_t site) {
+  DeepFuzzy_WriteTraceRecord(kind, offset, width, value, site, 0);
+}
+
+void DeepFuzzy_TraceBitsRead(uint32_t offset, uint32_t width, unsigned num_bits,
+                             uint64_t value, uint64_t site) {
+  DeepFuzzy_WriteTraceRecord(DeepFuzzy_TraceBits, offset, width,
+                             (int64_t) value, site, num_bits);
+}
+
+DEEPFUZZY_END_EXTERN_C
@@ -0,0 +1,28 @@
+from __future__ import print_function
+import logrun
+import deepfuzzy_base
+
+
+class CheckResetTest(deepfuzzy_base.DeepFuzzyTestCase):
+  def run_deepfuzzy(self, deepfuzzy):
+    if deepfuzzy != "--fuzz":
+      return
+
+    def fuzz(test):
+      return logrun.logrun(["build/examples/CheckReset",
+                            "--fuzz", "--no_fork", "--check_reset",
+                            "--timeout", "2",
+                            "--input_which_test", test,
+                            "--min_log_level", "1"],
+                           "deepfuzzy.out", 1800)
+
+    # State restored by a registered reset function doesn't leak.
+    (r, output) = fuzz("CheckReset_ResetState")
+    self.assertEqual(r, 0)
+    self.assertTrue("Done fuzzing!" in output)
+    self.assertFalse("Reset check failed" in output)
+    self.assertTrue(" with 0 failed/" in output)
+
+    # State that is never reset makes the second run of a test differ.
+    (r, output) = fuzz("CheckReset_LeakyState")
+    self.assertTrue("Reset check failed: CheckReset_LeakyState" in output)
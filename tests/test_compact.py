@@ -0,0 +1,40 @@
+from __future__ import print_function
+import os
+import subprocess
+import sys
+import logrun
+import deepfuzzy_base
+from glob import glob
+from tempfile import TemporaryDirectory
+
+
+class CompactEncodingTest(deepfuzzy_base.DeepFuzzyTestCase):
+  def run_deepfuzzy(self, deepfuzzy):
+    if deepfuzzy != "--fuzz":
+      return
+
+    with TemporaryDirectory(prefix="deepfuzzy_test_compact_") as tempdir:
+      (r, output) = logrun.logrun(["build/examples/OneOf_Compact",
+                                   "--fuzz", "--timeout", "2",
+                                   "--max_saves_per_bucket", "1",
+                                   "--output_test_dir", tempdir,
+                                   "--min_log_level", "2"],
+                    "deepfuzzy.out", 1800)
+      failing = glob(os.path.join(tempdir, "*.fail"))
+      self.assertEqual(len(failing), 1)
+
+      # The reducer works on the bits of the compact encoding like on any
+      # other input bytes.
+      reduced = os.path.join(tempdir, "reduced.test")
+      reducer = subprocess.run(["deepfuzzy-reduce", "build/examples/OneOf_Compact",
+                                failing[0], reduced,
+                                "--candidateName", os.path.join(tempdir, "candidate.test")],
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+      sys.stderr.write(reducer.stdout.decode("utf-8", "ignore"))
+      self.assertEqual(reducer.returncode, 0)
+      self.assertTrue(os.path.isfile(reduced))
+
+      (r, output) = logrun.logrun(["build/examples/OneOf_Compact",
+                                   "--input_test_file", reduced],
+                    "deepfuzzy.out", 1800)
+      self.assertTrue("Failed: OneOfExample_ProduceSixtyOrHigher" in output)
@@ -0,0 +1,28 @@
+from __future__ import print_function
+import os
+import re
+import logrun
+import deepfuzzy_base
+
+
+class CoverageTest(deepfuzzy_base.DeepFuzzyTestCase):
+  def run_deepfuzzy(self, deepfuzzy):
+    if deepfuzzy != "--fuzz":
+      return
+    # Only built when the compiler supports -fsanitize-coverage=trace-pc-guard.
+    if not os.path.exists("build/examples/Magic_Coverage"):
+      return
+
+    (r, output) = logrun.logrun(["build/examples/Magic_Coverage",
+                                 "--fuzz", "--coverage",
+                                 "--timeout", "10",
+                                 "--min_log_level", "1"],
+                  "deepfuzzy.out", 1800)
+    self.assertTrue("Done fuzzing!" in output)
+    self.assertFalse("No coverage instrumentation found" in output)
+
+    # Each matching byte reaches a new branch, and is kept in the corpus.
+    corpus = re.findall(r"Coverage: (\d+) inputs in corpus", output)
+    self.assertTrue(len(corpus) > 0)
+    self.assertTrue(int(corpus[-1]) >= 4)
+    self.assertTrue("Failed: Magic_Bytes" in output)
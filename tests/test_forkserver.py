@@ -0,0 +1,42 @@
+from __future__ import print_function
+import re
+import deepfuzzy_base
+import logrun
+from tempfile import TemporaryDirectory
+
+
+class ForkServerTest(deepfuzzy_base.DeepFuzzyTestCase):
+  def run_deepfuzzy(self, deepfuzzy):
+    if deepfuzzy != "--fuzz":
+      return
+
+    def outcomes(output):
+      return re.findall(r"^\w+: (Passed|Failed|Crashed): Outcomes_PassFailCrash$",
+                        output, re.MULTILINE)
+
+    with TemporaryDirectory(prefix="deepfuzzy_test_forkserver_") as tempdir:
+      # Crashing tests don't stop the fuzzer when forking from a fork server.
+      (r, output) = logrun.logrun(["build/examples/Outcomes",
+                                   "--fuzz", "--fork_server",
+                                   "--timeout", "1",
+                                   "--fuzz_save_passing",
+                                   "--max_saves_per_bucket", "5",
+                                   "--output_test_dir", tempdir,
+                                   "--min_log_level", "2"],
+                    "deepfuzzy.out", 1800)
+      self.assertTrue("Done fuzzing!" in output)
+
+      # Replaying the saved tests gives the same results with either way of
+      # forking.
+      (r, fork_output) = logrun.logrun(["build/examples/Outcomes", "--fork",
+                                        "--input_test_files_dir", tempdir],
+                         "deepfuzzy.out", 1800)
+      (r, server_output) = logrun.logrun(["build/examples/Outcomes", "--fork_server",
+                                          "--input_test_files_dir", tempdir],
+                           "deepfuzzy.out", 1800)
+
+    fork_outcomes = outcomes(fork_output)
+    self.assertTrue("Passed" in fork_outcomes)
+    self.assertTrue("Failed" in fork_outcomes)
+    self.assertTrue("Crashed" in fork_outcomes)
+    self.assertEqual(fork_outcomes, outcomes(server_output))
@@ -0,0 +1,70 @@
+from __future__ import print_function
+import re
+import logrun
+import deepfuzzy_base
+
+
+class OneOfPTest(deepfuzzy_base.DeepFuzzyTestCase):
+  def run_deepfuzzy(self, deepfuzzy):
+    if deepfuzzy != "--fuzz":
+      # Under symbolic execution, each choice is a path of its own.
+      (r, output) = logrun.logrun([deepfuzzy, "build/examples/OneOfP"],
+                    "deepfuzzy.out", 1800)
+      self.assertEqual(r, 0)
+      self.assertTrue("Passed: WithProbs_WP" in output)
+      self.assertTrue("Passed: WithProbs_SameLine" in output)
+      self.assertTrue("Passed: WithProbs_Varying" in output)
+      return
+
+    (r, output) = logrun.logrun(["build/examples/OneOfP",
+                                 "--fuzz", "--timeout", "2", "--seed", "1",
+                                 "--input_which_test", "WithProbs_WP"],
+                  "deepfuzzy.out", 1800, filters=["RESULT"])
+    results = re.findall(r"RESULT: '(.{11})'", output)
+    self.assertTrue(len(results) > 1000)
+
+    def frequency(position, choice):
+      return sum(result[position] == choice for result in results) / float(len(results))
+
+    # The first three choices may be overwritten by the last OneOfP.
+    for position in range(3, 10):
+      self.assertAlmostEqual(frequency(position, 'a'), 0.1, delta=0.03)
+      self.assertAlmostEqual(frequency(position, 'b'), 0.15, delta=0.03)
+      self.assertAlmostEqual(frequency(position, 'c'), 0.15, delta=0.03)
+      self.assertAlmostEqual(frequency(position, 'd'), 0.6, delta=0.03)
+    self.assertAlmostEqual(frequency(10, 'z'), 0.8, delta=0.03)
+    self.assertAlmostEqual(frequency(2, '!'), 0.9, delta=0.03)
+
+    # OneOfPs on one line with different numbers of choices keep their own
+    # probabilities.
+    (r, output) = logrun.logrun(["build/examples/OneOfP",
+                                 "--fuzz", "--timeout", "2", "--seed", "1",
+                                 "--input_which_test", "WithProbs_SameLine"],
+                  "deepfuzzy.out", 1800, filters=["SAMELINE"])
+    results = re.findall(r"SAMELINE: '(.{8})'", output)
+    self.assertTrue(len(results) > 1000)
+    self.assertFalse("Crashed: WithProbs_SameLine" in output)
+
+    for position in range(0, 8, 2):
+      self.assertAlmostEqual(frequency(position, 'x'), 0.7, delta=0.03)
+      self.assertAlmostEqual(frequency(position, 'y'), 0.3, delta=0.03)
+    for position in range(1, 8, 2):
+      self.assertAlmostEqual(frequency(position, 'a'), 0.2, delta=0.03)
+      self.assertAlmostEqual(frequency(position, 'b'), 0.3, delta=0.03)
+      self.assertAlmostEqual(frequency(position, 'c'), 0.5, delta=0.03)
+
+    # Probabilities that differ between calls at one site are not replaced by
+    # those of an earlier call.
+    (r, output) = logrun.logrun(["build/examples/OneOfP",
+                                 "--fuzz", "--timeout", "2", "--seed", "1",
+                                 "--input_which_test", "WithProbs_Varying"],
+                  "deepfuzzy.out", 1800, filters=["VARYING"])
+    results = re.findall(r"VARYING: '(.{10})'", output)
+    self.assertTrue(len(results) > 1000)
+
+    for position in range(0, 8, 2):
+      self.assertAlmostEqual(frequency(position, 'a'), 0.1, delta=0.03)
+    for position in range(1, 8, 2):
+      self.assertAlmostEqual(frequency(position, 'a'), 0.9, delta=0.03)
+    self.assertAlmostEqual(frequency(8, 'c'), 0.9, delta=0.03)
+    self.assertAlmostEqual(frequency(9, 'e'), 0.2, delta=0.03)
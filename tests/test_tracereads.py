@@ -0,0 +1,65 @@
+from __future__ import print_function
+import os
+import struct
+import subprocess
+import sys
+import logrun
+import deepfuzzy_base
+from glob import glob
+from tempfile import TemporaryDirectory
+
+# Layout of `struct DeepFuzzy_TraceRecord`, as read by the reducer.
+TRACE_RECORD = struct.Struct("=IIQqBB6x")
+TRACE_ONEOF_BEGIN = 8
+TRACE_ONEOF_END = 9
+
+
+class TraceReadsTest(deepfuzzy_base.DeepFuzzyTestCase):
+  def run_deepfuzzy(self, deepfuzzy):
+    if deepfuzzy != "--fuzz":
+      return
+
+    with TemporaryDirectory(prefix="deepfuzzy_test_tracereads_") as tempdir:
+      (r, output) = logrun.logrun(["build/examples/OneOf",
+                                   "--fuzz", "--timeout", "2",
+                                   "--max_saves_per_bucket", "1",
+                                   "--output_test_dir", tempdir,
+                                   "--min_log_level", "2"],
+                    "deepfuzzy.out", 1800)
+      failing = glob(os.path.join(tempdir, "*.fail"))
+      self.assertEqual(len(failing), 1)
+
+      # Replaying the test writes a record of each read, and of each OneOf.
+      trace = os.path.join(tempdir, "reads.trace")
+      (r, output) = logrun.logrun(["build/examples/OneOf",
+                                   "--input_test_file", failing[0],
+                                   "--trace_reads", trace],
+                    "deepfuzzy.out", 1800)
+      self.assertTrue("Failed: OneOfExample_ProduceSixtyOrHigher" in output)
+      with open(trace, "rb") as f:
+        data = f.read()
+      self.assertTrue(len(data) > 0)
+      self.assertEqual(len(data) % TRACE_RECORD.size, 0)
+      kinds = [TRACE_RECORD.unpack_from(data, i)[4]
+               for i in range(0, len(data), TRACE_RECORD.size)]
+      self.assertTrue(TRACE_ONEOF_BEGIN in kinds)
+      self.assertEqual(kinds.count(TRACE_ONEOF_BEGIN), kinds.count(TRACE_ONEOF_END))
+
+      # The reducer learns the same structure from the trace as from the
+      # output of --verbose_reads, so both reduce the test the same way.
+      def reduce(name, extra_args):
+        reduced = os.path.join(tempdir, name)
+        reducer = subprocess.run(["deepfuzzy-reduce", "build/examples/OneOf",
+                                  failing[0], reduced,
+                                  "--candidateName", os.path.join(tempdir, "candidate.test")] +
+                                 extra_args,
+                                 stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        sys.stderr.write(reducer.stdout.decode("utf-8", "ignore"))
+        self.assertEqual(reducer.returncode, 0)
+        with open(reduced, "rb") as f:
+          return f.read()
+
+      traced = reduce("traced.test", [])
+      verbose = reduce("verbose.test",
+                       ["--cmdArgs", "--input_test_file @@ --verbose_reads --no_fork"])
+      self.assertEqual(traced, verbose)